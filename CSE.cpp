@@ -0,0 +1,308 @@
+#include "CSE.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/InstructionSimplify.h"
+#include "llvm/Analysis/MemorySSA.h"
+#include "llvm/Analysis/MemorySSAUpdater.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/Dominators.h"
+
+using namespace llvm;
+
+
+static llvm::Statistic CSEDead = {"", "CSEDead", "CSE found dead instructions"};
+static llvm::Statistic CSEElim = {"", "CSEElim", "CSE redundant instructions"};
+static llvm::Statistic CSESimplify = {"", "CSESimplify", "CSE simplified instructions"};
+static llvm::Statistic CSELdElim = {"", "CSELdElim", "CSE redundant loads"};
+static llvm::Statistic CSEStore2Load = {"", "CSEStore2Load", "CSE forwarded store to load"};
+static llvm::Statistic CSEStElim = {"", "CSEStElim", "CSE redundant stores"};
+
+// Remark pass names; the same names select the stages in an opt pipeline.
+static const char *const BasicName = "p2-cse-basic";
+static const char *const SimplifyName = "p2-cse-simplify";
+static const char *const LoadElimName = "p2-cse-ldelim";
+
+
+static bool ignoreForCSE(Instruction &I){
+    /* Instruction is not a good candidate for CSE if they are of the following
+     * type: Loads, Stores, Terminators, VAArg, Calls, Allocas, and FCmps
+     */
+    if (isa<LoadInst>(&I) || isa<StoreInst>(&I) ||
+        isa<AllocaInst>(&I) || isa<FCmpInst>(&I) ||
+        isa<CallInst>(&I) || isa<VAArgInst>(&I)  ||
+        I.isTerminator()
+       ){
+        return true;
+    }
+
+    return false; 
+}
+
+static bool isLiteralMatch(Instruction &a, Instruction &b){
+    /* Remove IF:
+     * Same opcode
+     * Same type (LLVMTypeOf of the instruction not its operands)
+     * Same number of operands
+     * Same operands in the same order (no commutativity)
+     * */
+    if (a.getOpcode() == b.getOpcode() && a.getType() == b.getType() &&
+        a.getNumOperands() == b.getNumOperands()
+       ){
+
+        int c = a.getNumOperands() - 1;
+        while (c >= 0){
+            if (a.getOperand(c) != b.getOperand(c)) {return false;}
+            //if (a.getOperand(c)->getType() == b.getOperand(c)->getType()) {return false;}
+            //if (a.getOperand(c)->getValueID() == b.getOperand(c)->getValueID()) {return false;}
+            c--;
+        } 
+    	return true;
+    }
+    
+    return false;
+} 
+
+
+static bool shouldRemoveTrivialDeadCode(Instruction &x){
+    /* Similar to isTriviallyDeadInstruction
+     *
+     * Check whether instruction has any side effects
+     *
+     * Store / Volatie {load,store}/ Branch / Fence
+     * */
+    if (isa<CallInst>(&x) || x.mayHaveSideEffects() ||
+        x.isTerminator()
+       ){
+        return false;
+    }
+
+    if (x.use_empty()){
+        return true;
+    }
+
+    return false;
+}
+
+
+static void removeInstruction(Instruction &I, MemorySSAUpdater *MSSAU){
+    /* Erases an instruction, keeping MemorySSA (if it is cached) in sync so
+     * later stages do not have to rebuild it.
+     * */
+    if (MSSAU)
+        MSSAU->removeMemoryAccess(&I);
+    I.eraseFromParent();
+}
+
+static PreservedAnalyses getPreservedAnalyses(bool Changed, MemorySSAUpdater *MSSAU){
+    /* None of the CSE stages touch the CFG, so DominatorTree and friends
+     * survive. MemorySSA survives only if it was updated in place. AA is
+     * stateless and is kept as long as its dependencies are.
+     * */
+    if (!Changed)
+        return PreservedAnalyses::all();
+
+    PreservedAnalyses PA;
+    PA.preserveSet<CFGAnalyses>();
+    if (MSSAU)
+        PA.preserve<MemorySSAAnalysis>();
+    return PA;
+}
+
+bool runCSEBasic(Function &F, MemorySSAUpdater *MSSAU, OptimizationRemarkEmitter *ORE){
+    /**
+     * Runs the Basic CSE Pass
+     * Also Runs a non-aggresive Dead Code Elimination Pass
+     * */
+    bool Changed = false;
+    for (BasicBlock &BB : F){
+        for (Instruction &inst : make_early_inc_range(BB)){
+            //if (ignoreForCSE(inst)){
+
+            //FIXME: when you fully flesh out CSE, ensure proper ordering
+            //since there is no way you can run CSE on deleted instruction
+            if (shouldRemoveTrivialDeadCode(inst)){
+                if (ORE)
+                    ORE->emit([&]() {
+                        return OptimizationRemark(BasicName, "DeadInstruction", &inst)
+                               << "removed unused " << ore::NV("Opcode", inst.getOpcodeName());
+                    });
+                removeInstruction(inst, MSSAU);
+                CSEDead++;
+                Changed = true;
+            }
+        }
+    }
+    return Changed;
+}
+
+
+static void reportClobberedLoad(LoadInst &I, Instruction &Clobber,
+                                OptimizationRemarkEmitter &ORE){
+    /* I's worklist stopped at Clobber. If a later load in the block reads
+     * the same address, that is a load we would otherwise have eliminated.
+     * */
+    auto range = make_range(std::next(Clobber.getIterator()), I.getParent()->end());
+    for (Instruction &next : range){
+        if (isa<LoadInst>(&next) && !next.isVolatile() && isLiteralMatch(I, next)){
+            ORE.emit([&]() {
+                return OptimizationRemarkMissed(LoadElimName, "LoadClobbered", &next)
+                       << "load not eliminated, memory may be written by "
+                       << ore::NV("ClobberedBy", &Clobber);
+            });
+            return;
+        }
+    }
+}
+
+static bool RedundantLoadWorklist(LoadInst &I, AAResults &AA, MemorySSAUpdater *MSSAU,
+                                  OptimizationRemarkEmitter *ORE){
+    /* Eliminates later loads in the same basic block that read the same
+     * address as I, stopping at the first instruction that may write to it.
+     * */
+    Instruction* load =  &I;
+    MemoryLocation Loc = MemoryLocation::get(&I);
+    bool Changed = false;
+
+    // start considering the immediate next instruction
+    auto range = make_range(std::next(I.getIterator()), I.getParent()->end());
+    for (Instruction &next : make_early_inc_range(range)){
+        Instruction* next_inst = &next;
+        if (isa<LoadInst>(next_inst) && !next_inst->isVolatile()){
+            if (isLiteralMatch(I, *next_inst)){
+                if (ORE)
+                    ORE->emit([&]() {
+                        return OptimizationRemark(LoadElimName, "LoadEliminated", next_inst)
+                               << "load replaced by earlier load " << ore::NV("Load", load);
+                    });
+                next_inst->replaceAllUsesWith(load);
+                removeInstruction(*next_inst, MSSAU);
+                CSELdElim++;
+                Changed = true;
+            }
+        } else if (next_inst->mayWriteToMemory() &&
+                   isModSet(AA.getModRefInfo(next_inst, Loc))){
+            // Finding out what was missed costs a scan; only do it on request.
+            if (ORE && ORE->allowExtraAnalysis(LoadElimName))
+                reportClobberedLoad(I, *next_inst, *ORE);
+            break;
+        }
+    }
+    return Changed;
+}
+
+static bool RunSimplifyInstruction(Instruction &I, const SimplifyQuery &Q,
+                                   OptimizationRemarkEmitter *ORE){
+    /* Runs the simplifyInstruction library function
+     *
+     * If any simplification was achieved, it replaces the uses of this value
+     * */
+
+    Instruction *k;
+    k = &I;
+    Value* result = SimplifyInstruction(k, Q);
+
+    if (result != nullptr) {
+        if (ORE)
+            ORE->emit([&]() {
+                return OptimizationRemark(SimplifyName, "Simplified", k)
+                       << ore::NV("Opcode", k->getOpcodeName())
+                       << " simplified to " << ore::NV("Value", result);
+            });
+        //replace uses with result
+        k->replaceAllUsesWith(result);
+        CSESimplify++;
+        return true;
+    }
+    //leave it be
+    return false;
+}
+
+bool SimplifyInstructionPass(Function &F, const SimplifyQuery &Q, MemorySSAUpdater *MSSAU,
+                             OptimizationRemarkEmitter *ORE){
+    /* Runs a pass where you try do simple constant folding and such things
+     *
+     * */
+    bool Changed = false;
+    for (BasicBlock &BB : F){
+        for (Instruction &inst : make_early_inc_range(BB)){
+            if (RunSimplifyInstruction(inst, Q.getWithInstruction(&inst), ORE)){
+                removeInstruction(inst, MSSAU);
+                Changed = true;
+            }
+        }
+    }
+    return Changed;
+}
+
+bool EliminatRedundantLoadPass(Function &F, AAResults &AA, MemorySSAUpdater *MSSAU,
+                               OptimizationRemarkEmitter *ORE){
+    /* Examines a load and eliminates redundant loads within the same basic
+     * block
+     *
+     * The worklist only ever erases instructions after the current one, so
+     * a plain iterator stays valid here.
+     * */
+    bool Changed = false;
+    for (BasicBlock &BB : F){
+        for (BasicBlock::iterator bbi = BB.begin(); bbi != BB.end(); ++bbi){
+            LoadInst *load = dyn_cast<LoadInst>(&*bbi);
+            if (load && !load->isVolatile()){
+                Changed |= RedundantLoadWorklist(*load, AA, MSSAU, ORE);
+            }
+        }
+    }
+    return Changed;
+}
+
+PreservedAnalyses CSEBasicPass::run(Function &F, FunctionAnalysisManager &FAM){
+    auto *MSSA = FAM.getCachedResult<MemorySSAAnalysis>(F);
+    std::unique_ptr<MemorySSAUpdater> MSSAU;
+    if (MSSA)
+        MSSAU = std::make_unique<MemorySSAUpdater>(&MSSA->getMSSA());
+
+    auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+    bool Changed = runCSEBasic(F, MSSAU.get(), &ORE);
+    return getPreservedAnalyses(Changed, MSSAU.get());
+}
+
+PreservedAnalyses CSESimplifyPass::run(Function &F, FunctionAnalysisManager &FAM){
+    auto *MSSA = FAM.getCachedResult<MemorySSAAnalysis>(F);
+    std::unique_ptr<MemorySSAUpdater> MSSAU;
+    if (MSSA)
+        MSSAU = std::make_unique<MemorySSAUpdater>(&MSSA->getMSSA());
+
+    SimplifyQuery Q(F.getParent()->getDataLayout(),
+                    &FAM.getResult<TargetLibraryAnalysis>(F),
+                    &FAM.getResult<DominatorTreeAnalysis>(F),
+                    &FAM.getResult<AssumptionAnalysis>(F));
+    auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+    bool Changed = SimplifyInstructionPass(F, Q, MSSAU.get(), &ORE);
+    return getPreservedAnalyses(Changed, MSSAU.get());
+}
+
+PreservedAnalyses CSELoadElimPass::run(Function &F, FunctionAnalysisManager &FAM){
+    auto *MSSA = FAM.getCachedResult<MemorySSAAnalysis>(F);
+    std::unique_ptr<MemorySSAUpdater> MSSAU;
+    if (MSSA)
+        MSSAU = std::make_unique<MemorySSAUpdater>(&MSSA->getMSSA());
+
+    AAResults &AA = FAM.getResult<AAManager>(F);
+    auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+    bool Changed = EliminatRedundantLoadPass(F, AA, MSSAU.get(), &ORE);
+    return getPreservedAnalyses(Changed, MSSAU.get());
+}
+
+void CommonSubexpressionElimination(FunctionPassManager &FPM) {
+    /* Driver function
+     *
+     * Adds the different optimization sub-passes in a certain order
+     * */
+
+    FPM.addPass(CSEBasicPass());
+    FPM.addPass(CSESimplifyPass());
+    FPM.addPass(CSELoadElimPass());
+}
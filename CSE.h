@@ -0,0 +1,47 @@
+#ifndef P2_CSE_H
+#define P2_CSE_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+class AAResults;
+class MemorySSAUpdater;
+class OptimizationRemarkEmitter;
+struct SimplifyQuery;
+}
+
+/* CSE stages. Each one works on a single function and returns true if it
+ * changed anything. MSSAU may be null when MemorySSA is not cached. When
+ * ORE is given, every transformation is reported as an optimization remark
+ * (and missed ones as missed remarks) under the stage's pipeline name.
+ * */
+bool runCSEBasic(llvm::Function &F, llvm::MemorySSAUpdater *MSSAU,
+                 llvm::OptimizationRemarkEmitter *ORE = nullptr);
+bool SimplifyInstructionPass(llvm::Function &F, const llvm::SimplifyQuery &Q,
+                             llvm::MemorySSAUpdater *MSSAU,
+                             llvm::OptimizationRemarkEmitter *ORE = nullptr);
+bool EliminatRedundantLoadPass(llvm::Function &F, llvm::AAResults &AA,
+                               llvm::MemorySSAUpdater *MSSAU,
+                               llvm::OptimizationRemarkEmitter *ORE = nullptr);
+
+/* New pass manager wrappers around the CSE stages. Each one pulls the
+ * analyses it needs from the FunctionAnalysisManager, so results computed
+ * by an earlier stage (or by mem2reg) are reused rather than rebuilt.
+ * */
+struct CSEBasicPass : llvm::PassInfoMixin<CSEBasicPass> {
+    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+};
+
+struct CSESimplifyPass : llvm::PassInfoMixin<CSESimplifyPass> {
+    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+};
+
+struct CSELoadElimPass : llvm::PassInfoMixin<CSELoadElimPass> {
+    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+};
+
+/* Adds the full CSE pipeline, in order, to FPM. */
+void CommonSubexpressionElimination(llvm::FunctionPassManager &FPM);
+
+#endif
@@ -0,0 +1,70 @@
+#include "CodeGen.h"
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#if LLVM_VERSION_MAJOR >= 14
+#include "llvm/MC/TargetRegistry.h"
+#else
+#include "llvm/Support/TargetRegistry.h"
+#endif
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetOptions.h"
+
+using namespace llvm;
+
+void initializeNativeCodeGen() {
+    static bool Initialized = false;
+    if (Initialized)
+        return;
+
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+    Initialized = true;
+}
+
+std::unique_ptr<TargetMachine> createTargetMachine(const Module &M, std::string &Error) {
+    /* Mirrors llc's defaults (generic CPU, -O2), except that the relocation
+     * model follows the PIC/PIE level clang recorded in the module, so the
+     * object links with the same gcc command as llc's .s output.
+     * */
+    initializeNativeCodeGen();
+
+    Triple TheTriple(M.getTargetTriple());
+    if (TheTriple.getTriple().empty())
+        TheTriple.setTriple(sys::getDefaultTargetTriple());
+
+    const Target *TheTarget = TargetRegistry::lookupTarget(TheTriple.getTriple(), Error);
+    if (!TheTarget)
+        return nullptr;
+
+    Optional<Reloc::Model> RM;
+    if (M.getPICLevel() != PICLevel::NotPIC || M.getPIELevel() != PIELevel::Default)
+        RM = Reloc::PIC_;
+
+    TargetOptions Options;
+    std::unique_ptr<TargetMachine> TM(TheTarget->createTargetMachine(
+        TheTriple.getTriple(), "", "", Options, RM, None, CodeGenOpt::Default));
+    if (!TM)
+        Error = "could not allocate target machine for " + TheTriple.getTriple();
+    return TM;
+}
+
+bool emitNativeCode(Module &M, TargetMachine &TM, raw_pwrite_stream &OS,
+                    CodeGenFileType FileType, std::string &Error) {
+    M.setDataLayout(TM.createDataLayout());
+    if (M.getTargetTriple().empty())
+        M.setTargetTriple(TM.getTargetTriple().getTriple());
+
+    // The code generator still runs on the legacy pass manager.
+    legacy::PassManager CodeGenPasses;
+    if (TM.addPassesToEmitFile(CodeGenPasses, OS, nullptr, FileType)) {
+        Error = "target does not support emission of this file type";
+        return false;
+    }
+    CodeGenPasses.run(M);
+    return true;
+}
@@ -0,0 +1,34 @@
+#ifndef P2_CODEGEN_H
+#define P2_CODEGEN_H
+
+#include <memory>
+#include <string>
+
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Target/TargetMachine.h"
+
+namespace llvm {
+class Module;
+class raw_pwrite_stream;
+}
+
+/* Registers the native target with the MC layer. Safe to call more than
+ * once.
+ * */
+void initializeNativeCodeGen();
+
+/* Creates a TargetMachine for M's triple (or the host's, if M has none),
+ * configured the same way llc would be by default. Returns null and sets
+ * Error on failure.
+ * */
+std::unique_ptr<llvm::TargetMachine> createTargetMachine(const llvm::Module &M,
+                                                         std::string &Error);
+
+/* Runs the code generator on M, writing an object file (or assembly) to OS.
+ * Returns false and sets Error on failure.
+ * */
+bool emitNativeCode(llvm::Module &M, llvm::TargetMachine &TM,
+                    llvm::raw_pwrite_stream &OS, llvm::CodeGenFileType FileType,
+                    std::string &Error);
+
+#endif
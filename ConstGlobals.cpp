@@ -0,0 +1,90 @@
+#include "ConstGlobals.h"
+
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Transforms/IPO/Internalize.h"
+
+using namespace llvm;
+
+
+static llvm::Statistic ConstInternalized = {"", "ConstInternalized", "definitions internalized"};
+static llvm::Statistic ConstGlobals = {"", "ConstGlobals", "globals marked constant"};
+
+
+static bool isOnlyRead(Value *V){
+    /* True if the memory V points at is only ever loaded through V and the
+     * pointers derived from it, and V is not stored, passed or otherwise
+     * let out where it could be written through.
+     * */
+    for (User *U : V->users()){
+        if (auto *LI = dyn_cast<LoadInst>(U)){
+            if (LI->isVolatile())
+                return false;
+        } else if (isa<GetElementPtrInst>(U) || isa<BitCastInst>(U) ||
+                   isa<AddrSpaceCastInst>(U)){
+            if (!isOnlyRead(U))
+                return false;
+        } else if (auto *CE = dyn_cast<ConstantExpr>(U)){
+            if (CE->getOpcode() != Instruction::GetElementPtr &&
+                CE->getOpcode() != Instruction::BitCast &&
+                CE->getOpcode() != Instruction::AddrSpaceCast)
+                return false;
+            if (!isOnlyRead(CE))
+                return false;
+        } else if (isa<ICmpInst>(U)){
+            // Comparing the address reads nothing.
+        } else if (auto *MTI = dyn_cast<MemTransferInst>(U)){
+            // Copying out of the global, e.g. a struct initialized from it
+            if (MTI->isVolatile() || MTI->getRawDest() == V || MTI->getRawSource() != V)
+                return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static unsigned countExternalDefinitions(Module &M){
+    unsigned N = 0;
+    for (GlobalValue &GV : M.global_values())
+        if (!GV.isDeclaration() && !GV.hasLocalLinkage())
+            N++;
+    return N;
+}
+
+bool runConstantGlobals(Module &M, const std::vector<std::string> &Exported){
+    /* Internalizing first is what makes the second step possible: only a
+     * global with internal linkage is known to have all its uses in the
+     * module.
+     * */
+    StringSet<> Keep;
+    for (const std::string &Name : Exported)
+        Keep.insert(Name);
+
+    unsigned Before = countExternalDefinitions(M);
+    bool Changed = internalizeModule(M, [&](const GlobalValue &GV) {
+        return Keep.count(GV.getName()) > 0;
+    });
+    ConstInternalized += Before - countExternalDefinitions(M);
+
+    for (GlobalVariable &GV : M.globals()){
+        if (GV.isConstant() || !GV.hasLocalLinkage() || !GV.hasInitializer() ||
+            GV.isExternallyInitialized() || GV.isThreadLocal())
+            continue;
+        if (!isOnlyRead(&GV))
+            continue;
+        GV.setConstant(true);
+        ConstGlobals++;
+        Changed = true;
+    }
+    return Changed;
+}
+
+PreservedAnalyses ConstantGlobalsPass::run(Module &M, ModuleAnalysisManager &MAM){
+    if (!runConstantGlobals(M, Exported))
+        return PreservedAnalyses::all();
+    return PreservedAnalyses::none();
+}
@@ -0,0 +1,29 @@
+#ifndef P2_CONSTGLOBALS_H
+#define P2_CONSTGLOBALS_H
+
+#include <string>
+#include <vector>
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+
+/* Internalization and constant global promotion, for whole-program
+ * modules such as the linked benchmarks. Every definition except the
+ * Exported symbols (and llvm.used) gets internal linkage; then every
+ * internal global that is only ever loaded from, never written and whose
+ * address does not escape, is marked constant. Loads from such globals at
+ * constant addresses then fold to their initializer values in
+ * SimplifyInstruction. Returns true if anything changed.
+ * */
+bool runConstantGlobals(llvm::Module &M, const std::vector<std::string> &Exported);
+
+struct ConstantGlobalsPass : llvm::PassInfoMixin<ConstantGlobalsPass> {
+    std::vector<std::string> Exported;
+
+    explicit ConstantGlobalsPass(std::vector<std::string> Exported = {"main"})
+        : Exported(std::move(Exported)) {}
+
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM);
+};
+
+#endif
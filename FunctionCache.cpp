@@ -0,0 +1,330 @@
+#include "FunctionCache.h"
+
+#include <elf.h>
+#include <link.h>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ModuleSlotTracker.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+using namespace llvm;
+
+// Bump whenever the entry format changes. Changes to the stages themselves
+// are covered by the build identifier that goes into every key as well.
+static const char *CacheVersion = "p2-fcache-1";
+
+// Named metadata recording the original name of each struct type in an entry
+static const char *TypesMD = "p2.cache.types";
+
+static int findBuildId(dl_phdr_info *Info, size_t, void *Data) {
+    /* dl_iterate_phdr callback: reads the GNU build-id note of the main
+     * executable, which the runtime lists first.
+     * */
+    std::string &Id = *static_cast<std::string *>(Data);
+    for (int i = 0; i < Info->dlpi_phnum; i++) {
+        const ElfW(Phdr) &Ph = Info->dlpi_phdr[i];
+        if (Ph.p_type != PT_NOTE)
+            continue;
+        const char *P = reinterpret_cast<const char *>(Info->dlpi_addr + Ph.p_vaddr);
+        const char *End = P + Ph.p_memsz;
+        while (P + sizeof(ElfW(Nhdr)) <= End) {
+            auto *N = reinterpret_cast<const ElfW(Nhdr) *>(P);
+            const char *Name = P + sizeof(ElfW(Nhdr));
+            const char *Desc = Name + alignTo(N->n_namesz, 4);
+            if (N->n_type == NT_GNU_BUILD_ID && N->n_namesz == 4 &&
+                memcmp(Name, "GNU", 4) == 0) {
+                Id = toHex(StringRef(Desc, N->n_descsz));
+                return 1;
+            }
+            P = Desc + alignTo(N->n_descsz, 4);
+        }
+    }
+    return 1;
+}
+
+static const std::string &getBuildId() {
+    /* Identifies this p2 binary, so a rebuilt p2 never reuses bodies an
+     * older one optimized. Without a build-id note, the executable's size
+     * and modification time stand in for it.
+     * */
+    static const std::string Id = [] {
+        std::string Id;
+        dl_iterate_phdr(findBuildId, &Id);
+        if (!Id.empty())
+            return Id;
+        std::string Exe = sys::fs::getMainExecutable(nullptr, (void *)&getBuildId);
+        sys::fs::file_status Status;
+        if (!sys::fs::status(Exe, Status))
+            Id = utostr(Status.getSize()) + "-" +
+                 utostr(sys::toTimeT(Status.getLastModificationTime()));
+        return Id;
+    }();
+    return Id;
+}
+
+static void collectGlobals(const Constant *C, SetVector<const GlobalValue *> &Globals,
+                           SmallPtrSetImpl<const Constant *> &Visited) {
+    if (!Visited.insert(C).second)
+        return;
+    if (auto *GV = dyn_cast<GlobalValue>(C)) {
+        Globals.insert(GV);
+        return;
+    }
+    for (const Use &U : C->operands())
+        if (auto *Op = dyn_cast<Constant>(U.get()))
+            collectGlobals(Op, Globals, Visited);
+}
+
+static SetVector<const GlobalValue *> getReferencedGlobals(const Function &F) {
+    /* Every global F's body can see, in first-use order, including ones
+     * buried in constant expressions.
+     * */
+    SetVector<const GlobalValue *> Globals;
+    SmallPtrSet<const Constant *, 32> Visited;
+    if (F.hasPersonalityFn())
+        collectGlobals(F.getPersonalityFn(), Globals, Visited);
+    for (const BasicBlock &BB : F)
+        for (const Instruction &I : BB)
+            for (const Use &U : I.operands())
+                if (auto *C = dyn_cast<Constant>(U.get()))
+                    collectGlobals(C, Globals, Visited);
+    Globals.remove(&F);
+    return Globals;
+}
+
+static void cloneBody(Function *To, const Function *From, ValueToValueMapTy &VMap,
+                      ValueMapTypeRemapper *Types = nullptr) {
+    SmallVector<ReturnInst *, 8> Returns;
+    CloneFunctionInto(To, From, VMap, CloneFunctionChangeType::DifferentModule, Returns,
+                      "", nullptr, Types);
+
+    // Cross-module cloning always creates !llvm.dbg.cu; an empty one would
+    // make the module look like it has (invalid) debug info.
+    NamedMDNode *CUs = To->getParent()->getNamedMetadata("llvm.dbg.cu");
+    if (CUs && CUs->getNumOperands() == 0)
+        To->getParent()->eraseNamedMetadata(CUs);
+}
+
+FunctionCache::FunctionCache(const Module &M, StringRef Dir, StringRef Pipeline)
+    : Dir(Dir.str()), Pipeline(Pipeline.str()),
+      MST(new ModuleSlotTracker(&M, /*ShouldInitializeAllMetadata=*/false)) {
+    sys::fs::create_directories(Dir);
+}
+
+FunctionCache::~FunctionCache() = default;
+
+std::string FunctionCache::getPath(StringRef Key) const {
+    SmallString<128> Path(Dir);
+    sys::path::append(Path, Key + ".bc");
+    return std::string(Path.str());
+}
+
+std::string FunctionCache::getKey(const Function &F) const {
+    std::string Buf;
+    raw_string_ostream OS(Buf);
+    OS << CacheVersion << " " << getBuildId() << "\n" << Pipeline << "\n"
+       << F.getParent()->getDataLayoutStr() << "\n"
+       << F.getParent()->getTargetTriple() << "\n";
+    static_cast<const Value &>(F).print(OS, *MST);
+
+    // What the body may assume about everything it references
+    for (const GlobalValue *GV : getReferencedGlobals(F)) {
+        OS << GV->getName() << " " << (unsigned)GV->getLinkage() << " ";
+        GV->getValueType()->print(OS);
+        if (auto *G = dyn_cast<GlobalVariable>(GV)) {
+            OS << (G->isConstant() ? " constant" : " global");
+            if (G->isConstant() && G->hasDefinitiveInitializer()) {
+                OS << " ";
+                G->getInitializer()->print(OS, *MST);
+            }
+        } else if (auto *Callee = dyn_cast<Function>(GV)) {
+            OS << " " << Callee->getAttributes().getAsString(AttributeList::FunctionIndex);
+        } else {
+            GV->print(OS, *MST);
+        }
+        OS << "\n";
+    }
+    OS.flush();
+
+    MD5 Hash;
+    Hash.update(Buf);
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    return std::string(Result.digest().str());
+}
+
+void FunctionCache::store(const Function &F, StringRef Key) const {
+    /* The entry is a module with F's body and a declaration for each global
+     * it references, all with external linkage. Struct names are recorded
+     * separately since they get renamed when the entry is read back.
+     * */
+    LLVMContext &Ctx = F.getContext();
+    Module Entry(F.getName(), Ctx);
+    Entry.setDataLayout(F.getParent()->getDataLayout());
+    Entry.setTargetTriple(F.getParent()->getTargetTriple());
+
+    ValueToValueMapTy VMap;
+    for (const GlobalValue *GV : getReferencedGlobals(F)) {
+        GlobalValue *Decl;
+        if (auto *FT = dyn_cast<FunctionType>(GV->getValueType())) {
+            Function *D = Function::Create(FT, GlobalValue::ExternalLinkage,
+                                           GV->getAddressSpace(), GV->getName(), &Entry);
+            if (auto *Callee = dyn_cast<Function>(GV))
+                D->setAttributes(Callee->getAttributes());
+            Decl = D;
+        } else {
+            auto *G = dyn_cast<GlobalVariable>(GV);
+            Decl = new GlobalVariable(Entry, GV->getValueType(), G && G->isConstant(),
+                                      GlobalValue::ExternalLinkage, nullptr, GV->getName(),
+                                      nullptr, GV->getThreadLocalMode(), GV->getAddressSpace());
+        }
+        VMap[GV] = Decl;
+    }
+
+    Function *NewF = Function::Create(F.getFunctionType(), GlobalValue::ExternalLinkage,
+                                      F.getAddressSpace(), F.getName(), &Entry);
+    VMap[&F] = NewF;
+    auto NewArg = NewF->arg_begin();
+    for (const Argument &A : F.args()) {
+        NewArg->setName(A.getName());
+        VMap[&A] = &*NewArg++;
+    }
+    cloneBody(NewF, &F, VMap);
+
+    NamedMDNode *Types = Entry.getOrInsertNamedMetadata(TypesMD);
+    for (StructType *ST : Entry.getIdentifiedStructTypes()) {
+        Metadata *Ops[] = {
+            MDString::get(Ctx, ST->getName()),
+            ValueAsMetadata::get(UndefValue::get(PointerType::getUnqual(ST)))};
+        Types->addOperand(MDTuple::get(Ctx, Ops));
+    }
+
+    // Write to a temporary first so a concurrent reader never sees half a file
+    std::string Path = getPath(Key);
+    SmallString<128> Tmp;
+    int FD;
+    if (sys::fs::createUniqueFile(Path + ".%%%%%%", FD, Tmp))
+        return;
+    {
+        raw_fd_ostream OS(FD, /*shouldClose=*/true);
+        WriteBitcodeToFile(Entry, OS);
+    }
+    if (sys::fs::rename(Tmp, Path))
+        sys::fs::remove(Tmp);
+}
+
+namespace {
+/* Maps the (renamed) struct types of a cache entry back onto the module's
+ * own types of the same original name.
+ * */
+class EntryTypeMapper : public ValueMapTypeRemapper {
+public:
+    DenseMap<Type *, Type *> Map;
+
+    Type *remapType(Type *Ty) override {
+        auto It = Map.find(Ty);
+        if (It != Map.end())
+            return It->second;
+
+        Type *Result = Ty;
+        if (auto *PT = dyn_cast<PointerType>(Ty)) {
+            if (!PT->isOpaque())
+                Result = PointerType::get(remapType(PT->getNonOpaquePointerElementType()),
+                                          PT->getAddressSpace());
+        } else if (auto *AT = dyn_cast<ArrayType>(Ty)) {
+            Result = ArrayType::get(remapType(AT->getElementType()), AT->getNumElements());
+        } else if (auto *VT = dyn_cast<VectorType>(Ty)) {
+            Result = VectorType::get(remapType(VT->getElementType()), VT->getElementCount());
+        } else if (auto *FT = dyn_cast<FunctionType>(Ty)) {
+            SmallVector<Type *, 8> Params;
+            for (Type *P : FT->params())
+                Params.push_back(remapType(P));
+            Result = FunctionType::get(remapType(FT->getReturnType()), Params, FT->isVarArg());
+        } else if (auto *ST = dyn_cast<StructType>(Ty)) {
+            if (ST->isLiteral()) {
+                SmallVector<Type *, 8> Elts;
+                for (Type *E : ST->elements())
+                    Elts.push_back(remapType(E));
+                Result = StructType::get(Ty->getContext(), Elts, ST->isPacked());
+            }
+        }
+        Map[Ty] = Result;
+        return Result;
+    }
+};
+}
+
+bool FunctionCache::restore(Function &F, StringRef Key) const {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buf = MemoryBuffer::getFile(getPath(Key));
+    if (!Buf)
+        return false;
+
+    // Read the entry into the module's own context so it can be cloned over
+    Module &M = *F.getParent();
+    Expected<std::unique_ptr<Module>> Entry =
+        parseBitcodeFile((*Buf)->getMemBufferRef(), F.getContext());
+    if (!Entry) {
+        consumeError(Entry.takeError());
+        return false;
+    }
+
+    Function *CachedF = (*Entry)->getFunction(F.getName());
+    if (!CachedF || CachedF->isDeclaration())
+        return false;
+
+    EntryTypeMapper Types;
+    if (NamedMDNode *NMD = (*Entry)->getNamedMetadata(TypesMD)) {
+        for (MDNode *Op : NMD->operands()) {
+            auto *Name = dyn_cast<MDString>(Op->getOperand(0));
+            auto *Anchor = dyn_cast<ValueAsMetadata>(Op->getOperand(1));
+            if (!Name || !Anchor)
+                return false;
+            Type *Cached = cast<PointerType>(Anchor->getType())->getNonOpaquePointerElementType();
+            StructType *Own = StructType::getTypeByName(F.getContext(), Name->getString());
+            if (!Own)
+                return false;
+            Types.Map[Cached] = Own;
+        }
+    }
+
+    // Bind the entry's declarations to the module's globals, checking types
+    ValueToValueMapTy VMap;
+    for (GlobalValue &GV : (*Entry)->global_values()) {
+        if (&GV == CachedF)
+            continue;
+        GlobalValue *Own = M.getNamedValue(GV.getName());
+        if (!Own || Types.remapType(GV.getType()) != Own->getType())
+            return false;
+        VMap[&GV] = Own;
+    }
+    if (Types.remapType(CachedF->getFunctionType()) != F.getFunctionType())
+        return false;
+    VMap[CachedF] = &F;
+
+    // Swap the body; F keeps its own linkage, name and arguments
+    F.dropAllReferences();
+    auto Arg = F.arg_begin();
+    for (Argument &A : CachedF->args()) {
+        Arg->setName(A.getName());
+        VMap[&A] = &*Arg++;
+    }
+    cloneBody(&F, CachedF, VMap, &Types);
+    return true;
+}
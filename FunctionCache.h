@@ -0,0 +1,47 @@
+#ifndef P2_FUNCTIONCACHE_H
+#define P2_FUNCTIONCACHE_H
+
+#include <memory>
+#include <string>
+
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+class Function;
+class Module;
+class ModuleSlotTracker;
+}
+
+/* On-disk cache of optimized function bodies, so rebuilding a large module
+ * after a small source edit only re-optimizes the functions that changed.
+ *
+ * A function's key is a hash of the p2 build, the pipeline description,
+ * its own IR and the declarations of every global it references (types,
+ * linkage, attributes and, for constants, initializers). Each entry is a small
+ * bitcode module holding the optimized body plus those declarations.
+ * */
+class FunctionCache {
+public:
+    FunctionCache(const llvm::Module &M, llvm::StringRef Dir, llvm::StringRef Pipeline);
+    ~FunctionCache();
+
+    /* Computes F's cache key. Must be called before F is optimized. */
+    std::string getKey(const llvm::Function &F) const;
+
+    /* Replaces F's body with the cached one for Key. Returns false (and
+     * leaves F untouched) on a miss or if the entry no longer fits.
+     * */
+    bool restore(llvm::Function &F, llvm::StringRef Key) const;
+
+    /* Saves the (optimized) body of F under Key. */
+    void store(const llvm::Function &F, llvm::StringRef Key) const;
+
+private:
+    std::string getPath(llvm::StringRef Key) const;
+
+    std::string Dir;
+    std::string Pipeline;
+    std::unique_ptr<llvm::ModuleSlotTracker> MST;  // shared across keys
+};
+
+#endif
@@ -0,0 +1,168 @@
+#include "MergeFunctions.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/Transforms/Utils/FunctionComparator.h"
+
+using namespace llvm;
+
+
+static llvm::Statistic MergeFuncErased = {"", "MergeFuncErased", "merged functions erased"};
+static llvm::Statistic MergeFuncAliases = {"", "MergeFuncAliases", "merged functions replaced by aliases"};
+static llvm::Statistic MergeFuncThunks = {"", "MergeFuncThunks", "merged functions replaced by thunks"};
+static llvm::Statistic MergeFuncCalls = {"", "MergeFuncCalls", "calls redirected to a merged function"};
+
+// Remark pass name; the same name selects the stage in an opt pipeline.
+static const char *const MergeName = "p2-mergefunc";
+
+
+static bool isMergeCandidate(Function &F){
+    /* Only bodies that are final can be merged: a weak or linkonce
+     * definition may be replaced at link time. That includes the _odr
+     * forms and anything in a comdat, whose copy in this object the linker
+     * may discard along with any alias or thunk pointing into it. Variadic
+     * functions are left alone since a thunk cannot forward their
+     * arguments.
+     * */
+    return !F.isDeclaration() && !F.isInterposable() &&
+           !F.hasLinkOnceLinkage() && !F.hasWeakLinkage() && !F.hasComdat() &&
+           !F.hasAvailableExternallyLinkage() && !F.isVarArg() &&
+           !F.hasFnAttribute(Attribute::Naked);
+}
+
+static unsigned redirectDirectCalls(Function &G, Function &F){
+    /* Points every call that has G as its callee at F instead. Other uses
+     * (address taken, stored, compared) are left for the caller to handle.
+     * */
+    unsigned Count = 0;
+    for (Use &U : make_early_inc_range(G.uses())){
+        auto *CB = dyn_cast<CallBase>(U.getUser());
+        if (CB && CB->isCallee(&U)){
+            U.set(&F);
+            Count++;
+        }
+    }
+    return Count;
+}
+
+static void writeThunk(Function &G, Function &F){
+    /* Replaces G's body with a tail call to F, keeping G's name, linkage
+     * and address.
+     * */
+    GlobalValue::LinkageTypes Linkage = G.getLinkage();
+    G.deleteBody();
+    G.setLinkage(Linkage);
+
+    IRBuilder<> B(BasicBlock::Create(G.getContext(), "", &G));
+    SmallVector<Value *, 8> Args;
+    for (Argument &A : G.args())
+        Args.push_back(&A);
+
+    CallInst *CI = B.CreateCall(&F, Args);
+    CI->setTailCall();
+    CI->setCallingConv(F.getCallingConv());
+    CI->setAttributes(F.getAttributes());
+    if (G.getReturnType()->isVoidTy())
+        B.CreateRetVoid();
+    else
+        B.CreateRet(CI);
+}
+
+static void mergeInto(Function &G, Function &F){
+    /* F and G compared equal and have the same type; make G's callers and
+     * users use F. G is gone afterwards unless it had to become a thunk.
+     * */
+    OptimizationRemarkEmitter ORE(&G);
+    ORE.emit([&]() {
+        return OptimizationRemark(MergeName, "Merged", &G)
+               << ore::NV("Function", &G) << " merged into "
+               << ore::NV("Canonical", &F);
+    });
+
+    MergeFuncCalls += redirectDirectCalls(G, F);
+
+    if (G.isDiscardableIfUnused() && (G.use_empty() || G.hasGlobalUnnamedAddr())){
+        // Nobody can tell G and F apart any more.
+        G.replaceAllUsesWith(&F);
+        G.eraseFromParent();
+        MergeFuncErased++;
+    } else if (G.hasGlobalUnnamedAddr()){
+        // G must stay visible under its name, but its address is
+        // insignificant, so it may share F's.
+        GlobalAlias *GA = GlobalAlias::create(G.getValueType(), G.getAddressSpace(),
+                                              G.getLinkage(), "", &F, G.getParent());
+        GA->takeName(&G);
+        GA->setVisibility(G.getVisibility());
+        GA->setUnnamedAddr(G.getUnnamedAddr());
+        G.replaceAllUsesWith(GA);
+        G.eraseFromParent();
+        MergeFuncAliases++;
+    } else {
+        writeThunk(G, F);
+        MergeFuncThunks++;
+    }
+}
+
+bool mergeIdenticalFunctions(Module &M){
+    /* Redirecting calls can make more functions identical (two callers of
+     * a pair of merged functions now call the same one), so merge until
+     * nothing changes. Functions that were merged or became thunks are not
+     * considered again.
+     * */
+    GlobalNumberState GN;
+    std::vector<Function *> Candidates;
+    for (Function &F : M)
+        if (isMergeCandidate(F))
+            Candidates.push_back(&F);
+
+    bool Changed = false;
+    bool Merged = true;
+    while (Merged){
+        Merged = false;
+
+        // Buckets keep module order, so the kept function is deterministic.
+        std::map<FunctionComparator::FunctionHash, std::vector<Function *>> Buckets;
+        for (Function *F : Candidates)
+            Buckets[FunctionComparator::functionHash(*F)].push_back(F);
+
+        std::vector<Function *> Kept;
+        for (Function *F : Candidates){
+            std::vector<Function *> &Bucket = Buckets[FunctionComparator::functionHash(*F)];
+            Function *Canonical = nullptr;
+            for (Function *C : Bucket){
+                if (C == F)
+                    break;
+                if (C && C->getFunctionType() == F->getFunctionType() &&
+                    FunctionComparator(C, F, &GN).compare() == 0){
+                    Canonical = C;
+                    break;
+                }
+            }
+            if (!Canonical){
+                Kept.push_back(F);
+                continue;
+            }
+
+            // Later functions in the bucket must not compare against F.
+            std::replace(Bucket.begin(), Bucket.end(), F, (Function *)nullptr);
+            GN.erase(F);
+            mergeInto(*F, *Canonical);
+            Merged = Changed = true;
+        }
+        Candidates.swap(Kept);
+    }
+    return Changed;
+}
+
+PreservedAnalyses MergeIdenticalFunctionsPass::run(Module &M, ModuleAnalysisManager &MAM){
+    if (!mergeIdenticalFunctions(M))
+        return PreservedAnalyses::all();
+    return PreservedAnalyses::none();
+}
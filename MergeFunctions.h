@@ -0,0 +1,21 @@
+#ifndef P2_MERGEFUNCTIONS_H
+#define P2_MERGEFUNCTIONS_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+
+/* Identical function merging. Functions are bucketed by
+ * FunctionComparator::functionHash and confirmed equal with a full
+ * FunctionComparator::compare. Of each group of equal functions the first
+ * in the module is kept; direct calls to the others are redirected to it,
+ * and each other function is then erased if nothing else refers to it,
+ * turned into an alias if its address is insignificant, or else reduced to
+ * a thunk that tail-calls the kept one. Returns true if anything merged.
+ * */
+bool mergeIdenticalFunctions(llvm::Module &M);
+
+struct MergeIdenticalFunctionsPass : llvm::PassInfoMixin<MergeIdenticalFunctionsPass> {
+    llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM);
+};
+
+#endif
@@ -0,0 +1,313 @@
+#include "Peephole.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/MemorySSA.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+
+// InstructionWorklist logs under the including pass's DEBUG_TYPE.
+#define DEBUG_TYPE "p2-peephole"
+#include "llvm/Transforms/Utils/InstructionWorklist.h"
+
+
+static llvm::Statistic PeepholeDead = {"", "PeepholeDead", "peephole dead instructions"};
+static llvm::Statistic PeepholeCommute = {"", "PeepholeCommute", "peephole operands put in canonical order"};
+static llvm::Statistic PeepholeReassoc = {"", "PeepholeReassoc", "peephole constants reassociated"};
+static llvm::Statistic PeepholeShift = {"", "PeepholeShift", "peephole shifts combined"};
+static llvm::Statistic PeepholeShiftMask = {"", "PeepholeShiftMask", "peephole shift pairs turned into masks"};
+static llvm::Statistic PeepholeMulShift = {"", "PeepholeMulShift", "peephole multiplies turned into shifts"};
+static llvm::Statistic PeepholeSubAdd = {"", "PeepholeSubAdd", "peephole constant subtractions turned into adds"};
+static llvm::Statistic PeepholeCmpStrict = {"", "PeepholeCmpStrict", "peephole comparisons made strict"};
+static llvm::Statistic PeepholeCmpDiff = {"", "PeepholeCmpDiff", "peephole difference tests turned into comparisons"};
+
+// Remark pass name; the same name selects the stage in an opt pipeline.
+static const char *const PeepholeName = "p2-peephole";
+
+
+/* Rewrite rules. Each one looks at I and either returns nullptr (no
+ * match), I itself after changing it in place, or a replacement value
+ * built with B, which is positioned right before I. A rule must never
+ * undo another one, or the worklist would not terminate.
+ * */
+
+static unsigned getComplexity(Value *V){
+    /* Operand rank for commutative operations; the higher ranked operand
+     * goes on the left, so constants always end up on the right.
+     * */
+    if (isa<Constant>(V))
+        return 0;
+    if (isa<Argument>(V))
+        return 1;
+    return 2;
+}
+
+static Value *commuteOperands(Instruction &I, IRBuilder<> &B){
+    // c + a -> a + c, and icmp slt c, a -> icmp sgt a, c
+    if (I.getNumOperands() != 2 ||
+        getComplexity(I.getOperand(0)) >= getComplexity(I.getOperand(1)))
+        return nullptr;
+
+    if (auto *Cmp = dyn_cast<ICmpInst>(&I)){
+        Cmp->swapOperands();
+        return &I;
+    }
+    auto *BO = dyn_cast<BinaryOperator>(&I);
+    if (BO && BO->isCommutative() && !BO->swapOperands())
+        return &I;
+    return nullptr;
+}
+
+static Value *reassociateConstants(Instruction &I, IRBuilder<> &B){
+    // (a op c1) op c2 -> a op (c1 op c2), for integer add, mul, and, or, xor
+    auto *BO = dyn_cast<BinaryOperator>(&I);
+    if (!BO || !BO->getType()->isIntOrIntVectorTy() ||
+        !BO->isAssociative() || !BO->isCommutative())
+        return nullptr;
+
+    auto *Inner = dyn_cast<BinaryOperator>(BO->getOperand(0));
+    Constant *C1, *C2;
+    if (!Inner || Inner->getOpcode() != BO->getOpcode() ||
+        !match(Inner->getOperand(1), m_ImmConstant(C1)) ||
+        !match(BO->getOperand(1), m_ImmConstant(C2)))
+        return nullptr;
+
+    return B.CreateBinOp(BO->getOpcode(), Inner->getOperand(0),
+                         ConstantExpr::get(BO->getOpcode(), C1, C2));
+}
+
+static Value *combineShifts(Instruction &I, IRBuilder<> &B){
+    // (a shift c1) shift c2 -> a shift (c1+c2), for two shifts of one kind
+    unsigned Opcode = I.getOpcode();
+    if (Opcode != Instruction::Shl && Opcode != Instruction::LShr &&
+        Opcode != Instruction::AShr)
+        return nullptr;
+
+    auto *Inner = dyn_cast<BinaryOperator>(I.getOperand(0));
+    const APInt *C1, *C2;
+    if (!Inner || Inner->getOpcode() != Opcode ||
+        !match(Inner->getOperand(1), m_APInt(C1)) ||
+        !match(I.getOperand(1), m_APInt(C2)))
+        return nullptr;
+
+    // Out-of-range shifts are poison; leave them to SimplifyInstruction.
+    unsigned Width = C1->getBitWidth();
+    if (C1->uge(Width) || C2->uge(Width))
+        return nullptr;
+
+    // Shifting everything out leaves zero, or the sign for ashr.
+    uint64_t Sum = C1->getZExtValue() + C2->getZExtValue();
+    if (Sum >= Width){
+        if (Opcode != Instruction::AShr)
+            return Constant::getNullValue(I.getType());
+        Sum = Width - 1;
+    }
+    return B.CreateBinOp((Instruction::BinaryOps)Opcode, Inner->getOperand(0),
+                         ConstantInt::get(I.getType(), Sum));
+}
+
+static Value *shiftsToMask(Instruction &I, IRBuilder<> &B){
+    // (a << c) >>u c -> a & (-1 >>u c), and (a >>u c) << c -> a & (-1 << c)
+    Value *X;
+    const APInt *C1, *C2;
+    bool Left;
+    if (match(&I, m_LShr(m_Shl(m_Value(X), m_APInt(C1)), m_APInt(C2))))
+        Left = false;
+    else if (match(&I, m_Shl(m_LShr(m_Value(X), m_APInt(C1)), m_APInt(C2))))
+        Left = true;
+    else
+        return nullptr;
+
+    unsigned Width = C1->getBitWidth();
+    if (*C1 != *C2 || C1->uge(Width))
+        return nullptr;
+
+    APInt Mask = APInt::getMaxValue(Width);
+    Mask = Left ? Mask.shl(*C1) : Mask.lshr(*C1);
+    return B.CreateAnd(X, ConstantInt::get(I.getType(), Mask));
+}
+
+static Value *multiplyToShift(Instruction &I, IRBuilder<> &B){
+    // a * 2^c -> a << c
+    Value *X;
+    const APInt *C;
+    if (!match(&I, m_Mul(m_Value(X), m_Power2(C))))
+        return nullptr;
+    return B.CreateShl(X, ConstantInt::get(I.getType(), C->logBase2()));
+}
+
+static Value *subtractToAdd(Instruction &I, IRBuilder<> &B){
+    // a - c -> a + (-c), so that reassociation and CSE only see adds
+    Value *X;
+    const APInt *C;
+    if (!match(&I, m_Sub(m_Value(X), m_APInt(C))) || isa<Constant>(X))
+        return nullptr;
+    return B.CreateAdd(X, ConstantInt::get(I.getType(), -*C));
+}
+
+static Value *strictCompare(Instruction &I, IRBuilder<> &B){
+    // icmp sge a, c -> icmp sgt a, c-1, and likewise for sle, uge, ule
+    auto *Cmp = dyn_cast<ICmpInst>(&I);
+    const APInt *C;
+    if (!Cmp || !match(Cmp->getOperand(1), m_APInt(C)))
+        return nullptr;
+
+    ICmpInst::Predicate Pred;
+    APInt NewC = *C;
+    switch (Cmp->getPredicate()){
+    case ICmpInst::ICMP_SGE:
+        if (C->isMinSignedValue())
+            return nullptr;
+        Pred = ICmpInst::ICMP_SGT;
+        --NewC;
+        break;
+    case ICmpInst::ICMP_SLE:
+        if (C->isMaxSignedValue())
+            return nullptr;
+        Pred = ICmpInst::ICMP_SLT;
+        ++NewC;
+        break;
+    case ICmpInst::ICMP_UGE:
+        if (C->isMinValue())
+            return nullptr;
+        Pred = ICmpInst::ICMP_UGT;
+        --NewC;
+        break;
+    case ICmpInst::ICMP_ULE:
+        if (C->isMaxValue())
+            return nullptr;
+        Pred = ICmpInst::ICMP_ULT;
+        ++NewC;
+        break;
+    default:
+        return nullptr;
+    }
+    Cmp->setPredicate(Pred);
+    Cmp->setOperand(1, ConstantInt::get(Cmp->getOperand(1)->getType(), NewC));
+    return &I;
+}
+
+static Value *compareDifference(Instruction &I, IRBuilder<> &B){
+    // (a - b) == 0 -> a == b, and the same for a ^ b and for !=
+    ICmpInst::Predicate Pred;
+    Value *X, *Y;
+    if (!match(&I, m_ICmp(Pred, m_Sub(m_Value(X), m_Value(Y)), m_Zero())) &&
+        !match(&I, m_ICmp(Pred, m_Xor(m_Value(X), m_Value(Y)), m_Zero())))
+        return nullptr;
+    if (!ICmpInst::isEquality(Pred))
+        return nullptr;
+    return B.CreateICmp(Pred, X, Y);
+}
+
+struct PeepholeRule {
+    const char *Name;           // remark name
+    Value *(*Rewrite)(Instruction &I, IRBuilder<> &B);
+    llvm::Statistic *Count;
+};
+
+// Tried in order; the first rule that matches wins.
+static const PeepholeRule Rules[] = {
+    {"CommuteOperands", commuteOperands, &PeepholeCommute},
+    {"ReassociateConstants", reassociateConstants, &PeepholeReassoc},
+    {"CombineShifts", combineShifts, &PeepholeShift},
+    {"ShiftsToMask", shiftsToMask, &PeepholeShiftMask},
+    {"MultiplyToShift", multiplyToShift, &PeepholeMulShift},
+    {"SubtractToAdd", subtractToAdd, &PeepholeSubAdd},
+    {"StrictCompare", strictCompare, &PeepholeCmpStrict},
+    {"CompareDifference", compareDifference, &PeepholeCmpDiff},
+};
+
+
+static bool eraseIfDead(Instruction &I, InstructionWorklist &Worklist){
+    /* Instructions that touch memory are left to the CSE stages, which keep
+     * MemorySSA up to date; everything else can go as soon as it is unused.
+     * */
+    if (I.mayReadOrWriteMemory() || !isInstructionTriviallyDead(&I))
+        return false;
+
+    for (Use &Op : I.operands())
+        if (auto *OpI = dyn_cast<Instruction>(Op.get()))
+            Worklist.push(OpI);
+    Worklist.remove(&I);
+    I.eraseFromParent();
+    PeepholeDead++;
+    return true;
+}
+
+static bool applyRules(Instruction &I, InstructionWorklist &Worklist, IRBuilder<> &B,
+                       OptimizationRemarkEmitter *ORE){
+    for (const PeepholeRule &R : Rules){
+        B.SetInsertPoint(&I);
+        Value *V = R.Rewrite(I, B);
+        if (!V)
+            continue;
+
+        if (ORE)
+            ORE->emit([&]() {
+                return OptimizationRemark(PeepholeName, R.Name, &I)
+                       << ore::NV("Opcode", I.getOpcodeName())
+                       << " rewritten to " << ore::NV("Value", V);
+            });
+        (*R.Count)++;
+
+        // Whatever uses the result may match a rule now.
+        Worklist.pushUsersToWorkList(I);
+        if (V == &I){
+            Worklist.push(&I);
+        } else {
+            I.replaceAllUsesWith(V);
+            if (auto *NewI = dyn_cast<Instruction>(V)){
+                NewI->takeName(&I);
+                Worklist.push(NewI);
+            }
+            // Now dead; popped first and erased.
+            Worklist.push(&I);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool runPeephole(Function &F, OptimizationRemarkEmitter *ORE){
+    /* Worklist driver in the style of InstCombine: every instruction is
+     * visited in program order, and whatever a rewrite touches (the new
+     * instruction, users of the old one, operands of erased ones) is
+     * visited again until no rule matches anywhere.
+     * */
+    InstructionWorklist Worklist;
+    SmallVector<Instruction *, 128> Order;
+    for (Instruction &I : instructions(F))
+        Order.push_back(&I);
+    Worklist.reserve(Order.size());
+    for (Instruction *I : reverse(Order))
+        Worklist.push(I);
+
+    IRBuilder<> B(F.getContext());
+    bool Changed = false;
+    while (!Worklist.isEmpty()){
+        Instruction *I = Worklist.removeOne();
+        if (!I)
+            continue;
+        if (eraseIfDead(*I, Worklist) || applyRules(*I, Worklist, B, ORE))
+            Changed = true;
+    }
+    Worklist.zap();
+    return Changed;
+}
+
+PreservedAnalyses PeepholePass::run(Function &F, FunctionAnalysisManager &FAM){
+    auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+    if (!runPeephole(F, &ORE))
+        return PreservedAnalyses::all();
+
+    // No block or memory access was touched.
+    PreservedAnalyses PA;
+    PA.preserveSet<CFGAnalyses>();
+    PA.preserve<MemorySSAAnalysis>();
+    return PA;
+}
@@ -0,0 +1,26 @@
+#ifndef P2_PEEPHOLE_H
+#define P2_PEEPHOLE_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+class OptimizationRemarkEmitter;
+}
+
+/* Peephole combiner. Unlike SimplifyInstruction, which can only replace an
+ * instruction with an existing value, its rules may build new
+ * instructions, e.g. (a*c1)*c2 -> a*(c1*c2) or (a<<c)>>c -> a&mask. It
+ * brings integer expressions to one canonical form (constants on the
+ * right, strict comparisons, shifts instead of multiplies by powers of
+ * two) so that equal expressions look equal to CSE. Only arithmetic and
+ * comparisons are rewritten; memory and the CFG are left alone. Returns
+ * true if anything changed.
+ * */
+bool runPeephole(llvm::Function &F, llvm::OptimizationRemarkEmitter *ORE = nullptr);
+
+struct PeepholePass : llvm::PassInfoMixin<PeepholePass> {
+    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+};
+
+#endif
@@ -0,0 +1,73 @@
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+#include "CSE.h"
+#include "ConstGlobals.h"
+#include "MergeFunctions.h"
+#include "Peephole.h"
+#include "PromoteGlobals.h"
+#include "SROA.h"
+
+using namespace llvm;
+
+/* Exposes the p2 stages to opt, e.g.
+ *
+ *   opt -load-pass-plugin=libP2Passes.so -passes=mem2reg,p2-cse,gvn in.bc
+ *
+ * so they can run inside an existing pipeline without a separate p2
+ * process and bitcode round-trip.
+ * */
+static bool parseP2Pipeline(StringRef Name, FunctionPassManager &FPM,
+                            ArrayRef<PassBuilder::PipelineElement>) {
+    if (Name == "p2-cse") {
+        CommonSubexpressionElimination(FPM);
+        return true;
+    }
+    if (Name == "p2-cse-basic") {
+        FPM.addPass(CSEBasicPass());
+        return true;
+    }
+    if (Name == "p2-cse-simplify") {
+        FPM.addPass(CSESimplifyPass());
+        return true;
+    }
+    if (Name == "p2-cse-ldelim") {
+        FPM.addPass(CSELoadElimPass());
+        return true;
+    }
+    if (Name == "p2-peephole") {
+        FPM.addPass(PeepholePass());
+        return true;
+    }
+    if (Name == "p2-sroa") {
+        FPM.addPass(ScalarReplAggregatesPass());
+        return true;
+    }
+    // Loops without a preheader are skipped; run loop-simplify first.
+    if (Name == "p2-promote-globals") {
+        FPM.addPass(PromoteLoopGlobalsPass());
+        return true;
+    }
+    return false;
+}
+
+static bool parseP2ModulePipeline(StringRef Name, ModulePassManager &MPM,
+                                  ArrayRef<PassBuilder::PipelineElement>) {
+    if (Name == "p2-mergefunc") {
+        MPM.addPass(MergeIdenticalFunctionsPass());
+        return true;
+    }
+    if (Name == "p2-const-globals") {
+        MPM.addPass(ConstantGlobalsPass());
+        return true;
+    }
+    return false;
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+    return {LLVM_PLUGIN_API_VERSION, "P2Passes", "0.1",
+            [](PassBuilder &PB) {
+                PB.registerPipelineParsingCallback(parseP2Pipeline);
+                PB.registerPipelineParsingCallback(parseP2ModulePipeline);
+            }};
+}
@@ -0,0 +1,250 @@
+#include "PromoteGlobals.h"
+
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/Loads.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+
+using namespace llvm;
+
+
+static llvm::Statistic PromotedGlobals = {"", "PromotedGlobals", "globals promoted to registers in loops"};
+static llvm::Statistic PromotedLoads = {"", "PromotedLoads", "global loads removed from loops"};
+static llvm::Statistic PromotedStores = {"", "PromotedStores", "global stores sunk out of loops"};
+
+// Remark pass name; the same name selects the stage in an opt pipeline.
+static const char *const PromoteName = "p2-promote-globals";
+
+
+namespace {
+/* Rewrites one global's loads and stores in a loop to SSA values. The
+ * preheader load is registered as the incoming value before run(); this
+ * adds the stores back in the exit blocks. When the loop need not store,
+ * a flag tracks whether it did, and the exit store is made conditional on
+ * it.
+ * */
+class GlobalPromoter : public LoadAndStorePromoter {
+    Value *Ptr;
+    Align Alignment;
+    ArrayRef<BasicBlock *> Exits;
+    SSAUpdater *Dirty;
+    DominatorTree &DT;
+    LoopInfo &LI;
+
+public:
+    GlobalPromoter(ArrayRef<const Instruction *> Insts, SSAUpdater &S, Value *Ptr,
+                   Align Alignment, ArrayRef<BasicBlock *> Exits, SSAUpdater *Dirty,
+                   DominatorTree &DT, LoopInfo &LI)
+        : LoadAndStorePromoter(Insts, S, Ptr->getName()), Ptr(Ptr), Alignment(Alignment),
+          Exits(Exits), Dirty(Dirty), DT(DT), LI(LI) {}
+
+    void doExtraRewritesBeforeFinalDeletion() override {
+        for (BasicBlock *Exit : Exits){
+            Value *V = SSA.GetValueInMiddleOfBlock(Exit);
+            Instruction *InsertPt = &*Exit->getFirstInsertionPt();
+            if (Dirty){
+                Value *Stored = Dirty->GetValueInMiddleOfBlock(Exit);
+                InsertPt = SplitBlockAndInsertIfThen(Stored, InsertPt, false,
+                                                     nullptr, &DT, &LI);
+            }
+            new StoreInst(V, Ptr, false, Alignment, InsertPt);
+        }
+    }
+};
+
+/* The loads and stores of one constant address in a loop. */
+struct Candidate {
+    Value *Ptr;
+    SmallVector<Instruction *, 8> Accesses;
+};
+}
+
+static bool isGlobalAddress(Value *Ptr){
+    /* A global, or a constant GEP into one. An extern_weak global may be
+     * null, so it cannot be loaded speculatively in the preheader.
+     * */
+    if (!isa<Constant>(Ptr))
+        return false;
+    auto *GV = dyn_cast<GlobalVariable>(getUnderlyingObject(Ptr));
+    return GV && !GV->hasExternalWeakLinkage();
+}
+
+static bool storeIsGuaranteed(Loop &L, ArrayRef<Instruction *> Accesses, DominatorTree &DT){
+    /* True if every way out of the loop passes a store first, i.e. some
+     * store's block dominates all exiting blocks.
+     * */
+    SmallVector<BasicBlock *, 4> Exiting;
+    L.getExitingBlocks(Exiting);
+    for (Instruction *I : Accesses){
+        if (!isa<StoreInst>(I))
+            continue;
+        if (all_of(Exiting, [&](BasicBlock *E) { return DT.dominates(I->getParent(), E); }))
+            return true;
+    }
+    return false;
+}
+
+static bool canPromote(Candidate &C, ArrayRef<Instruction *> MemInsts, AAResults &AA,
+                       OptimizationRemarkEmitter *ORE){
+    Type *Ty = getLoadStoreType(C.Accesses[0]);
+    Align Alignment = getLoadStoreAlignment(C.Accesses[0]);
+    for (Instruction *I : C.Accesses){
+        auto *SI = dyn_cast<StoreInst>(I);
+        if (getLoadStoreType(I) != Ty ||
+            (isa<LoadInst>(I) && !cast<LoadInst>(I)->isSimple()) ||
+            (SI && (!SI->isSimple() || SI->getValueOperand() == C.Ptr)))
+            return false;
+        Alignment = std::min(Alignment, getLoadStoreAlignment(I));
+    }
+
+    // The preheader load runs even when the loop's accesses are guarded,
+    // so the address must be in bounds of the global, e.g. not a constant
+    // GEP past its end.
+    const DataLayout &DL = C.Accesses[0]->getModule()->getDataLayout();
+    if (!isDereferenceableAndAlignedPointer(C.Ptr, Ty, Alignment, DL)){
+        if (ORE)
+            ORE->emit([&]() {
+                return OptimizationRemarkMissed(PromoteName, "NotDereferenceable", C.Accesses[0])
+                       << ore::NV("Global", C.Ptr)
+                       << " not promoted, the address may be out of bounds";
+            });
+        return false;
+    }
+
+    // Nothing else in the loop may read or write the same memory.
+    MemoryLocation Loc(C.Ptr, LocationSize::precise(DL.getTypeStoreSize(Ty)));
+    for (Instruction *I : MemInsts){
+        if (is_contained(C.Accesses, I) || !isModOrRefSet(AA.getModRefInfo(I, Loc)))
+            continue;
+        if (ORE)
+            ORE->emit([&]() {
+                return OptimizationRemarkMissed(PromoteName, "GlobalClobbered", C.Accesses[0])
+                       << ore::NV("Global", C.Ptr)
+                       << " not promoted, the loop may also access it through "
+                       << ore::NV("Access", I);
+            });
+        return false;
+    }
+    return true;
+}
+
+static void promote(Loop &L, Candidate &C, ArrayRef<BasicBlock *> Exits,
+                    DominatorTree &DT, LoopInfo &LI, OptimizationRemarkEmitter *ORE){
+    Type *Ty = getLoadStoreType(C.Accesses[0]);
+    Align Alignment = getLoadStoreAlignment(C.Accesses[0]);
+    bool HasStore = false;
+    for (Instruction *I : C.Accesses){
+        Alignment = std::min(Alignment, getLoadStoreAlignment(I));
+        if (isa<StoreInst>(I)){
+            HasStore = true;
+            PromotedStores++;
+        } else {
+            PromotedLoads++;
+        }
+    }
+
+    if (ORE)
+        ORE->emit([&]() {
+            return OptimizationRemark(PromoteName, "PromotedGlobal", L.getStartLoc(), L.getHeader())
+                   << ore::NV("Global", C.Ptr) << " kept in a register in the loop";
+        });
+
+    BasicBlock *Preheader = L.getLoopPreheader();
+    auto *Initial = new LoadInst(Ty, C.Ptr, C.Ptr->getName() + ".promoted", false,
+                                 Alignment, Preheader->getTerminator());
+
+    SSAUpdater SSA;
+    SSAUpdater Dirty;
+    bool Conditional = HasStore && !storeIsGuaranteed(L, C.Accesses, DT);
+    if (Conditional){
+        LLVMContext &Ctx = Preheader->getContext();
+        Dirty.Initialize(Type::getInt1Ty(Ctx), (C.Ptr->getName() + ".stored").str());
+        Dirty.AddAvailableValue(Preheader, ConstantInt::getFalse(Ctx));
+        for (Instruction *I : C.Accesses)
+            if (isa<StoreInst>(I))
+                Dirty.AddAvailableValue(I->getParent(), ConstantInt::getTrue(Ctx));
+    }
+
+    SmallVector<const Instruction *, 8> Insts(C.Accesses.begin(), C.Accesses.end());
+    GlobalPromoter Promoter(Insts, SSA, C.Ptr, Alignment,
+                            HasStore ? Exits : ArrayRef<BasicBlock *>(),
+                            Conditional ? &Dirty : nullptr, DT, LI);
+    SSA.AddAvailableValue(Preheader, Initial);
+    Promoter.run(C.Accesses);
+    PromotedGlobals++;
+}
+
+static bool promoteInLoop(Loop &L, DominatorTree &DT, LoopInfo &LI, AAResults &AA,
+                          OptimizationRemarkEmitter *ORE){
+    BasicBlock *Preheader = L.getLoopPreheader();
+    if (!Preheader || !L.hasDedicatedExits())
+        return false;
+    SmallVector<BasicBlock *, 4> Exits;
+    L.getUniqueExitBlocks(Exits);
+    // A loop that never exits has nowhere to put the stores back.
+    if (Exits.empty() || any_of(Exits, [](BasicBlock *E) { return E->isEHPad(); }))
+        return false;
+
+    // Group the loop's accesses by constant global address.
+    MapVector<Value *, Candidate> Candidates;
+    SmallVector<Instruction *, 32> MemInsts;
+    for (BasicBlock *BB : L.blocks()){
+        for (Instruction &I : *BB){
+            if (!I.mayReadOrWriteMemory())
+                continue;
+            MemInsts.push_back(&I);
+            Value *Ptr = getLoadStorePointerOperand(&I);
+            if (Ptr && isGlobalAddress(Ptr)){
+                Candidate &C = Candidates[Ptr];
+                C.Ptr = Ptr;
+                C.Accesses.push_back(&I);
+            }
+        }
+    }
+
+    // Decide first: promoting one candidate deletes instructions that the
+    // checks for the others walk over.
+    SmallVector<Candidate *, 4> Promotable;
+    for (auto &KV : Candidates)
+        if (canPromote(KV.second, MemInsts, AA, ORE))
+            Promotable.push_back(&KV.second);
+    for (Candidate *C : Promotable)
+        promote(L, *C, Exits, DT, LI, ORE);
+    return !Promotable.empty();
+}
+
+bool runPromoteLoopGlobals(Function &F, LoopInfo &LI, DominatorTree &DT, AAResults &AA,
+                           OptimizationRemarkEmitter *ORE){
+    /* Inner loops first: the preheader load and exit stores they leave
+     * behind are plain accesses in the enclosing loop, which can then
+     * promote them again.
+     * */
+    bool Changed = false;
+    SmallVector<Loop *, 8> Loops = LI.getLoopsInPreorder();
+    for (Loop *L : reverse(Loops))
+        Changed |= promoteInLoop(*L, DT, LI, AA, ORE);
+    return Changed;
+}
+
+PreservedAnalyses PromoteLoopGlobalsPass::run(Function &F, FunctionAnalysisManager &FAM){
+    auto &LI = FAM.getResult<LoopAnalysis>(F);
+    auto &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+    auto &AA = FAM.getResult<AAManager>(F);
+    auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+    if (!runPromoteLoopGlobals(F, LI, DT, AA, &ORE))
+        return PreservedAnalyses::all();
+
+    // Conditional exit stores split blocks, but keep both of these current.
+    PreservedAnalyses PA;
+    PA.preserve<DominatorTreeAnalysis>();
+    PA.preserve<LoopAnalysis>();
+    return PA;
+}
@@ -0,0 +1,30 @@
+#ifndef P2_PROMOTEGLOBALS_H
+#define P2_PROMOTEGLOBALS_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+class AAResults;
+class DominatorTree;
+class LoopInfo;
+class OptimizationRemarkEmitter;
+}
+
+/* Scalar promotion of globals in loops. A global (or a constant field of
+ * one) that a loop only reads and writes through simple loads and stores,
+ * and that alias analysis shows nothing else in the loop can touch, is
+ * loaded once in the preheader, kept in a register inside the loop, and
+ * stored back in each exit block. The store is only sunk when the loop is
+ * guaranteed to store before leaving, so no write is introduced on paths
+ * that had none. Loops must be in loop-simplify form (preheader, dedicated
+ * exits); others are skipped. Returns true if anything changed.
+ * */
+bool runPromoteLoopGlobals(llvm::Function &F, llvm::LoopInfo &LI, llvm::DominatorTree &DT,
+                           llvm::AAResults &AA, llvm::OptimizationRemarkEmitter *ORE = nullptr);
+
+struct PromoteLoopGlobalsPass : llvm::PassInfoMixin<PromoteLoopGlobalsPass> {
+    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "Run.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "CodeGen.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+
+/* Benchmarks call exit() when they are done. Inside the JIT that would take
+ * p2 down with them, so exit is bound to this stub, which unwinds back to
+ * the run loop instead.
+ * */
+static jmp_buf RunExitJmp;
+static int RunExitCode;
+
+static void runExit(int code) {
+    fflush(nullptr);
+    RunExitCode = code;
+    longjmp(RunExitJmp, 1);
+}
+
+static int callMain(int (*Main)(int, char **), std::vector<char *> &Argv) {
+    RunExitCode = 0;
+    if (setjmp(RunExitJmp) == 0)
+        RunExitCode = Main(Argv.size() - 1, Argv.data());
+    fflush(nullptr);
+    return RunExitCode;
+}
+
+static Expected<std::unique_ptr<LLJIT>> createJIT(StringRef Bitcode) {
+    /* Each run gets its own JIT and its own copy of the module, parsed from
+     * the same in-memory bitcode.
+     * */
+    auto Context = std::make_unique<LLVMContext>();
+    Expected<std::unique_ptr<Module>> M =
+        parseBitcodeFile(MemoryBufferRef(Bitcode, "<run>"), *Context);
+    if (!M)
+        return M.takeError();
+
+    auto J = LLJITBuilder().create();
+    if (!J)
+        return J.takeError();
+
+    JITDylib &JD = (*J)->getMainJITDylib();
+    auto Gen = DynamicLibrarySearchGenerator::GetForCurrentProcess(
+        (*J)->getDataLayout().getGlobalPrefix());
+    if (!Gen)
+        return Gen.takeError();
+    JD.addGenerator(std::move(*Gen));
+
+    MangleAndInterner Mangle((*J)->getExecutionSession(), (*J)->getDataLayout());
+    if (Error Err = JD.define(absoluteSymbols(
+            {{Mangle("exit"), JITEvaluatedSymbol(pointerToJITTargetAddress(&runExit),
+                                                 JITSymbolFlags::Exported)}})))
+        return std::move(Err);
+
+    if (Error Err = (*J)->addIRModule(ThreadSafeModule(std::move(*M), std::move(Context))))
+        return std::move(Err);
+    return J;
+}
+
+int runModuleJIT(const Module &M, const RunOptions &Opts) {
+    initializeNativeCodeGen();
+
+    SmallString<0> Bitcode;
+    raw_svector_ostream BCOS(Bitcode);
+    WriteBitcodeToFile(M, BCOS);
+
+    std::vector<std::string> Args;
+    Args.push_back(M.getModuleIdentifier());
+    Args.insert(Args.end(), Opts.Args.begin(), Opts.Args.end());
+
+    int SavedStdout = -1;
+    int ExitCode = 0;
+    std::vector<double> Times;
+    for (unsigned i = 0; i < std::max(Opts.Repeat, 1u); i++) {
+        auto J = createJIT(Bitcode);
+        if (!J) {
+            errs() << "p2: " << toString(J.takeError()) << "\n";
+            return -1;
+        }
+
+        // Materialize main outside the timed region
+        auto MainSym = (*J)->lookup("main");
+        if (!MainSym) {
+            errs() << "p2: " << toString(MainSym.takeError()) << "\n";
+            return -1;
+        }
+        if (Error Err = (*J)->initialize((*J)->getMainJITDylib())) {
+            errs() << "p2: " << toString(std::move(Err)) << "\n";
+            return -1;
+        }
+        auto *Main = jitTargetAddressToFunction<int (*)(int, char **)>(MainSym->getAddress());
+
+        if (!Opts.Input.empty() && !freopen(Opts.Input.c_str(), "r", stdin)) {
+            errs() << "p2: cannot open " << Opts.Input << "\n";
+            return -1;
+        }
+
+        // Keep the first run's output only, so it can be compared as usual
+        if (i == 1) {
+            fflush(stdout);
+            SavedStdout = dup(STDOUT_FILENO);
+            int Null = open("/dev/null", O_WRONLY);
+            dup2(Null, STDOUT_FILENO);
+            close(Null);
+        }
+
+        std::vector<char *> Argv;
+        for (std::string &A : Args)
+            Argv.push_back(&A[0]);
+        Argv.push_back(nullptr);
+
+        auto Start = std::chrono::steady_clock::now();
+        ExitCode = callMain(Main, Argv);
+        auto End = std::chrono::steady_clock::now();
+        Times.push_back(std::chrono::duration<double>(End - Start).count());
+
+        if (Error Err = (*J)->deinitialize((*J)->getMainJITDylib()))
+            consumeError(std::move(Err));
+    }
+
+    if (SavedStdout >= 0) {
+        fflush(stdout);
+        dup2(SavedStdout, STDOUT_FILENO);
+        close(SavedStdout);
+    }
+
+    std::vector<double> Sorted = Times;
+    std::sort(Sorted.begin(), Sorted.end());
+    for (unsigned i = 0; i < Times.size(); i++)
+        errs() << format("run %u: %.6f s\n", i + 1, Times[i]);
+    errs() << format("min %.6f s, median %.6f s over %u runs\n", Sorted.front(),
+                     Sorted[Sorted.size() / 2], (unsigned)Sorted.size());
+
+    if (!Opts.TimeFile.empty()) {
+        std::error_code EC;
+        raw_fd_ostream TF(Opts.TimeFile, EC, sys::fs::OF_Text);
+        if (EC) {
+            errs() << "p2: " << Opts.TimeFile << ": " << EC.message() << "\n";
+        } else {
+            // Same format RunSafely.sh produces, so timing.py can read it
+            TF << format("program %f\n", Sorted.front());
+            TF << "exit " << ExitCode << "\n";
+        }
+    }
+    return ExitCode;
+}
@@ -0,0 +1,26 @@
+#ifndef P2_RUN_H
+#define P2_RUN_H
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Module;
+}
+
+struct RunOptions {
+    std::vector<std::string> Args;  // argv[1..] for main
+    std::string Input;              // file to use as stdin, empty to inherit
+    std::string TimeFile;           // where to write "program <sec>", or empty
+    unsigned Repeat = 1;            // number of timed runs
+};
+
+/* JIT-compiles M with ORC LLJIT and runs its main() Opts.Repeat times,
+ * timing each call in-process. Every run starts from a fresh copy of the
+ * module, so globals are reset without relinking anything. Only the first
+ * run's stdout is kept. Returns main's exit code from the last run, or -1
+ * if the module could not be JIT-compiled.
+ * */
+int runModuleJIT(const llvm::Module &M, const RunOptions &Opts);
+
+#endif
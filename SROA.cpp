@@ -0,0 +1,256 @@
+#include "SROA.h"
+
+#include <map>
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+
+using namespace llvm;
+
+// Larger aggregates are usually arrays walked by a loop, which we cannot
+// split anyway; this just bounds the work per alloca.
+#define SROA_MAX_ELEMENTS 32
+
+static llvm::Statistic SROASplit = {"", "SROASplit", "SROA aggregate allocas split"};
+static llvm::Statistic SROAElements = {"", "SROAElements", "SROA element allocas created"};
+static llvm::Statistic SROAPromoted = {"", "SROAPromoted", "SROA element allocas promoted"};
+
+// Remark pass name; the same name selects the stage in an opt pipeline.
+static const char *const SROAName = "p2-sroa";
+
+
+static uint64_t countElements(Type *Ty){
+    /* Number of scalar elements in Ty once nested structs and arrays are
+     * flattened. */
+    if (auto *ST = dyn_cast<StructType>(Ty)){
+        uint64_t N = 0;
+        for (Type *E : ST->elements())
+            N += countElements(E);
+        return N;
+    }
+    if (auto *AT = dyn_cast<ArrayType>(Ty))
+        return AT->getNumElements() * countElements(AT->getElementType());
+    return 1;
+}
+
+static bool isAggregate(Type *Ty){
+    return isa<StructType>(Ty) || isa<ArrayType>(Ty);
+}
+
+namespace {
+/* One scalar element of the aggregate: its type, its byte offset, and the
+ * GEPs that point at it. Elements are numbered in flattened order.
+ * */
+struct Element {
+    Type *Ty = nullptr;
+    uint64_t Offset = 0;
+    SmallVector<Instruction *, 4> Ptrs;
+};
+}
+
+static bool isLifetimeMarker(User *U){
+    auto *II = dyn_cast<IntrinsicInst>(U);
+    return II && II->isLifetimeStartOrEnd();
+}
+
+static bool collectUses(Value *Ptr, Type *Ty, uint64_t First, uint64_t Offset,
+                        const DataLayout &DL, std::map<uint64_t, Element> &Elements,
+                        SmallVectorImpl<Instruction *> &Dead){
+    /* Ptr points at Ty, which starts at flattened element First and byte
+     * Offset of the alloca. Records every GEP that reaches a scalar element
+     * and every instruction that goes away with the alloca (intermediate
+     * GEPs, lifetime markers and their casts), users before their operands.
+     * Returns false on any use we cannot rewrite.
+     * */
+    for (User *U : Ptr->users()){
+        if (auto *GEP = dyn_cast<GetElementPtrInst>(U)){
+            auto *Idx0 = dyn_cast<ConstantInt>(GEP->getOperand(1));
+            if (GEP->getPointerOperand() != Ptr || !Idx0 || !Idx0->isZero())
+                return false;
+
+            Type *T = Ty;
+            uint64_t F = First, O = Offset;
+            for (unsigned i = 2; i < GEP->getNumOperands(); i++){
+                auto *C = dyn_cast<ConstantInt>(GEP->getOperand(i));
+                if (!C)
+                    return false;
+                if (auto *ST = dyn_cast<StructType>(T)){
+                    unsigned K = C->getZExtValue();
+                    for (unsigned j = 0; j < K; j++)
+                        F += countElements(ST->getElementType(j));
+                    O += DL.getStructLayout(ST)->getElementOffset(K);
+                    T = ST->getElementType(K);
+                } else if (auto *AT = dyn_cast<ArrayType>(T)){
+                    if (C->getValue().uge(AT->getNumElements()))
+                        return false;
+                    uint64_t K = C->getZExtValue();
+                    F += K * countElements(AT->getElementType());
+                    O += K * DL.getTypeAllocSize(AT->getElementType());
+                    T = AT->getElementType();
+                } else {
+                    return false;
+                }
+            }
+
+            if (!collectUses(GEP, T, F, O, DL, Elements, Dead))
+                return false;
+            if (isAggregate(T)){
+                Dead.push_back(GEP);
+            } else {
+                Element &E = Elements[F];
+                E.Ty = T;
+                E.Offset = O;
+                E.Ptrs.push_back(GEP);
+            }
+        } else if (auto *LI = dyn_cast<LoadInst>(U)){
+            if (isAggregate(Ty) || LI->getType() != Ty || LI->isVolatile())
+                return false;
+        } else if (auto *SI = dyn_cast<StoreInst>(U)){
+            if (isAggregate(Ty) || SI->getValueOperand() == Ptr ||
+                SI->getValueOperand()->getType() != Ty || SI->isVolatile())
+                return false;
+        } else if (auto *BC = dyn_cast<BitCastInst>(U)){
+            // clang casts to i8* for lifetime.start/end
+            if (!all_of(BC->users(), isLifetimeMarker))
+                return false;
+            for (User *M : BC->users())
+                Dead.push_back(cast<Instruction>(M));
+            Dead.push_back(BC);
+        } else if (isLifetimeMarker(U)){
+            Dead.push_back(cast<Instruction>(U));
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void declareFragment(DbgDeclareInst *DDI, AllocaInst *NewAI, uint64_t Offset,
+                            DIBuilder &DIB){
+    /* Describes the element alloca NewAI, Offset bytes into the variable
+     * DDI declares, with a fragment of that variable. mem2reg then turns
+     * it into fragment dbg.values along with the loads and stores.
+     * */
+    const DataLayout &DL = NewAI->getModule()->getDataLayout();
+    uint64_t Size = DL.getTypeSizeInBits(NewAI->getAllocatedType());
+    DILocalVariable *Var = DDI->getVariable();
+    DIExpression *Expr = DDI->getExpression();
+
+    // A fragment may not cover the whole variable.
+    Optional<uint64_t> VarSize = Var->getSizeInBits();
+    if (Expr->getFragmentInfo() || Offset != 0 || !VarSize || Size != *VarSize){
+        Optional<DIExpression *> Frag =
+            DIExpression::createFragmentExpression(Expr, Offset * 8, Size);
+        if (!Frag)
+            return;
+        Expr = *Frag;
+    }
+    DIB.insertDeclare(NewAI, Var, Expr, DDI->getDebugLoc().get(), DDI);
+}
+
+static bool splitAlloca(AllocaInst &AI, SmallVectorImpl<AllocaInst *> &NewAllocas,
+                        OptimizationRemarkEmitter *ORE){
+    const DataLayout &DL = AI.getModule()->getDataLayout();
+    std::map<uint64_t, Element> Elements;
+    SmallVector<Instruction *, 16> Dead;
+
+    // dbg.declares are rewritten per element below; a dbg.addr is not,
+    // so such allocas are left alone rather than losing the variable.
+    TinyPtrVector<DbgVariableIntrinsic *> DbgUses = FindDbgAddrUses(&AI);
+    if (any_of(DbgUses, [](DbgVariableIntrinsic *D) { return !isa<DbgDeclareInst>(D); }))
+        return false;
+
+    if (!collectUses(&AI, AI.getAllocatedType(), 0, 0, DL, Elements, Dead)){
+        if (ORE)
+            ORE->emit([&]() {
+                return OptimizationRemarkMissed(SROAName, "NotSplit", &AI)
+                       << "aggregate not split, it is used other than by "
+                          "constant-index element loads and stores";
+            });
+        return false;
+    }
+
+    if (ORE)
+        ORE->emit([&]() {
+            return OptimizationRemark(SROAName, "Split", &AI)
+                   << "split " << ore::NV("Alloca", AI.getName()) << " into "
+                   << ore::NV("Elements", (unsigned)Elements.size()) << " scalars";
+        });
+
+    // Elements that are never accessed simply disappear.
+    DIBuilder DIB(*AI.getModule(), /*AllowUnresolved=*/false);
+    for (auto &KV : Elements){
+        Element &E = KV.second;
+        Align A = std::max(DL.getABITypeAlign(E.Ty), commonAlignment(AI.getAlign(), E.Offset));
+        auto *NewAI = new AllocaInst(E.Ty, AI.getType()->getAddressSpace(), nullptr, A,
+                                     AI.getName() + "." + Twine(KV.first), &AI);
+        for (DbgVariableIntrinsic *D : DbgUses)
+            declareFragment(cast<DbgDeclareInst>(D), NewAI, E.Offset, DIB);
+        for (Instruction *P : E.Ptrs)
+            P->replaceAllUsesWith(NewAI);
+        for (Instruction *P : E.Ptrs)
+            P->eraseFromParent();
+        NewAllocas.push_back(NewAI);
+        SROAElements++;
+    }
+    for (Instruction *I : Dead)
+        I->eraseFromParent();
+    for (DbgVariableIntrinsic *D : DbgUses)
+        D->eraseFromParent();
+    AI.eraseFromParent();
+    SROASplit++;
+    return true;
+}
+
+bool runSROA(Function &F, DominatorTree &DT, AssumptionCache &AC,
+             OptimizationRemarkEmitter *ORE){
+    /* Only static allocas in the entry block are candidates; those are the
+     * ones mem2reg can promote afterwards.
+     * */
+    SmallVector<AllocaInst *, 16> Candidates;
+    for (Instruction &I : F.getEntryBlock()){
+        auto *AI = dyn_cast<AllocaInst>(&I);
+        if (!AI || !AI->isStaticAlloca() || AI->isArrayAllocation() ||
+            !isAggregate(AI->getAllocatedType()))
+            continue;
+        uint64_t N = countElements(AI->getAllocatedType());
+        if (N > 0 && N <= SROA_MAX_ELEMENTS)
+            Candidates.push_back(AI);
+    }
+
+    SmallVector<AllocaInst *, 32> NewAllocas;
+    bool Changed = false;
+    for (AllocaInst *AI : Candidates)
+        Changed |= splitAlloca(*AI, NewAllocas, ORE);
+
+    SmallVector<AllocaInst *, 32> Promotable;
+    for (AllocaInst *AI : NewAllocas)
+        if (isAllocaPromotable(AI))
+            Promotable.push_back(AI);
+    if (!Promotable.empty()){
+        PromoteMemToReg(Promotable, DT, &AC);
+        SROAPromoted += Promotable.size();
+    }
+    return Changed;
+}
+
+PreservedAnalyses ScalarReplAggregatesPass::run(Function &F, FunctionAnalysisManager &FAM){
+    auto &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+    auto &AC = FAM.getResult<AssumptionAnalysis>(F);
+    auto &ORE = FAM.getResult<OptimizationRemarkEmitterAnalysis>(F);
+    if (!runSROA(F, DT, AC, &ORE))
+        return PreservedAnalyses::all();
+
+    // Loads and stores are gone, so MemorySSA is not kept.
+    PreservedAnalyses PA;
+    PA.preserveSet<CFGAnalyses>();
+    return PA;
+}
@@ -0,0 +1,28 @@
+#ifndef P2_SROA_H
+#define P2_SROA_H
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/PassManager.h"
+
+namespace llvm {
+class AssumptionCache;
+class DominatorTree;
+class OptimizationRemarkEmitter;
+}
+
+/* Scalar replacement of aggregates. A struct or array alloca of at most
+ * SROA_MAX_ELEMENTS scalar elements is split into one alloca per element
+ * when every use reaches a single element through constant-index GEPs and
+ * is a plain load or store of that element (or a lifetime marker). The new
+ * allocas are then promoted to registers where mem2reg allows it. An
+ * aggregate that escapes, is indexed by a variable, or is copied or
+ * accessed as a whole is left alone. Returns true if anything changed.
+ * */
+bool runSROA(llvm::Function &F, llvm::DominatorTree &DT, llvm::AssumptionCache &AC,
+             llvm::OptimizationRemarkEmitter *ORE = nullptr);
+
+struct ScalarReplAggregatesPass : llvm::PassInfoMixin<ScalarReplAggregatesPass> {
+    llvm::PreservedAnalyses run(llvm::Function &F, llvm::FunctionAnalysisManager &FAM);
+};
+
+#endif
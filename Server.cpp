@@ -0,0 +1,272 @@
+#include "Server.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+/* Wire format, one request per connection:
+ *
+ *   client -> server  uint32 payload size, with stdin/stdout/stderr
+ *                     attached as SCM_RIGHTS
+ *                     payload: cwd \0 argv[0] \0 argv[1] \0 ...
+ *   server -> client  int32 exit status
+ * */
+
+static const int NumFds = 3;
+
+std::string p2SocketPath() {
+    if (const char *Env = getenv("P2_SOCKET"))
+        return Env;
+    return "/tmp/p2-" + std::to_string(getuid()) + ".sock";
+}
+
+static bool makeAddress(const std::string &Path, sockaddr_un &Addr) {
+    memset(&Addr, 0, sizeof(Addr));
+    Addr.sun_family = AF_UNIX;
+    if (Path.size() >= sizeof(Addr.sun_path)) {
+        fprintf(stderr, "p2: socket path too long: %s\n", Path.c_str());
+        return false;
+    }
+    strcpy(Addr.sun_path, Path.c_str());
+    return true;
+}
+
+static bool sendAll(int Fd, const void *Buf, size_t Size) {
+    const char *P = static_cast<const char *>(Buf);
+    while (Size) {
+        ssize_t N = send(Fd, P, Size, MSG_NOSIGNAL);
+        if (N < 0 && errno == EINTR)
+            continue;
+        if (N <= 0)
+            return false;
+        P += N;
+        Size -= N;
+    }
+    return true;
+}
+
+static bool readAll(int Fd, void *Buf, size_t Size) {
+    char *P = static_cast<char *>(Buf);
+    while (Size) {
+        ssize_t N = read(Fd, P, Size);
+        if (N < 0 && errno == EINTR)
+            continue;
+        if (N <= 0)
+            return false;
+        P += N;
+        Size -= N;
+    }
+    return true;
+}
+
+static bool recvHeader(int Conn, uint32_t &Size, int *Fds) {
+    char Control[CMSG_SPACE(NumFds * sizeof(int))];
+    iovec Iov = {&Size, sizeof(Size)};
+    msghdr Msg;
+    memset(&Msg, 0, sizeof(Msg));
+    Msg.msg_iov = &Iov;
+    Msg.msg_iovlen = 1;
+    Msg.msg_control = Control;
+    Msg.msg_controllen = sizeof(Control);
+
+    ssize_t N;
+    do {
+        N = recvmsg(Conn, &Msg, MSG_CMSG_CLOEXEC);
+    } while (N < 0 && errno == EINTR);
+    // On error or EOF the control buffer was never filled in.
+    if (N <= 0)
+        return false;
+
+    cmsghdr *C = CMSG_FIRSTHDR(&Msg);
+    if (!C || C->cmsg_level != SOL_SOCKET || C->cmsg_type != SCM_RIGHTS ||
+        C->cmsg_len != CMSG_LEN(NumFds * sizeof(int)))
+        return false;
+    memcpy(Fds, CMSG_DATA(C), NumFds * sizeof(int));
+
+    // The descriptors are ours now, even if the rest of the header is short.
+    if (N != sizeof(Size)) {
+        for (int i = 0; i < NumFds; i++)
+            close(Fds[i]);
+        return false;
+    }
+    return true;
+}
+
+static int ListenFd = -1;
+
+static void runChild(int Conn, int *Fds, std::vector<std::string> &Strings,
+                     int (*Handler)(int, char **)) {
+    /* Becomes the client's p2: its stdio, its working directory, its
+     * arguments. Never returns.
+     * */
+    for (int i = 0; i < NumFds; i++)
+        dup2(Fds[i], i);
+    close(Conn);
+    close(ListenFd);
+    signal(SIGPIPE, SIG_DFL);
+
+    if (chdir(Strings[0].c_str()) != 0) {
+        fprintf(stderr, "p2: cannot enter %s: %s\n", Strings[0].c_str(), strerror(errno));
+        _exit(1);
+    }
+
+    std::vector<char *> Argv;
+    for (size_t i = 1; i < Strings.size(); i++)
+        Argv.push_back(&Strings[i][0]);
+    Argv.push_back(nullptr);
+
+    int Code = Handler(Argv.size() - 1, Argv.data());
+    fflush(nullptr);
+    exit(Code);
+}
+
+static void handleConnection(int Conn, int (*Handler)(int, char **)) {
+    uint32_t Size;
+    int Fds[NumFds];
+    if (!recvHeader(Conn, Size, Fds)) {
+        close(Conn);
+        return;
+    }
+
+    std::string Payload(Size, '\0');
+    std::vector<std::string> Strings;
+    if (readAll(Conn, &Payload[0], Size)) {
+        for (size_t Pos = 0; Pos < Payload.size();) {
+            size_t End = Payload.find('\0', Pos);
+            if (End == std::string::npos)
+                End = Payload.size();
+            Strings.push_back(Payload.substr(Pos, End - Pos));
+            Pos = End + 1;
+        }
+    }
+
+    int32_t Status = 1;
+    if (Strings.size() >= 2) {
+        pid_t Pid = fork();
+        if (Pid == 0)
+            runChild(Conn, Fds, Strings, Handler);
+
+        int WaitStatus;
+        if (Pid > 0 && waitpid(Pid, &WaitStatus, 0) == Pid) {
+            if (WIFEXITED(WaitStatus))
+                Status = WEXITSTATUS(WaitStatus);
+            else if (WIFSIGNALED(WaitStatus))
+                Status = 128 + WTERMSIG(WaitStatus);
+        }
+    }
+
+    for (int i = 0; i < NumFds; i++)
+        close(Fds[i]);
+    sendAll(Conn, &Status, sizeof(Status));
+    close(Conn);
+}
+
+int serve(const std::string &SocketPath, int (*Handler)(int, char **)) {
+    sockaddr_un Addr;
+    if (!makeAddress(SocketPath, Addr))
+        return 1;
+
+    ListenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (ListenFd < 0) {
+        perror("p2: socket");
+        return 1;
+    }
+
+    // A socket file nobody answers on is left over from a dead server.
+    if (connect(ListenFd, (sockaddr *)&Addr, sizeof(Addr)) == 0) {
+        fprintf(stderr, "p2: a server is already listening on %s\n", SocketPath.c_str());
+        return 1;
+    }
+    close(ListenFd);
+    unlink(SocketPath.c_str());
+
+    ListenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    mode_t Mask = umask(0077);
+    int Bound = bind(ListenFd, (sockaddr *)&Addr, sizeof(Addr));
+    umask(Mask);
+    if (Bound != 0 || listen(ListenFd, 128) != 0) {
+        fprintf(stderr, "p2: cannot listen on %s: %s\n", SocketPath.c_str(), strerror(errno));
+        return 1;
+    }
+
+    // A client that goes away must not take the server with it.
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "p2: serving on %s\n", SocketPath.c_str());
+
+    for (;;) {
+        int Conn = accept4(ListenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (Conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("p2: accept");
+            return 1;
+        }
+        // One thread per request, which only forks and waits, so
+        // concurrent builds are served concurrently.
+        std::thread(handleConnection, Conn, Handler).detach();
+    }
+}
+
+int sendRequest(const std::string &SocketPath, int argc, char **argv) {
+    sockaddr_un Addr;
+    if (!makeAddress(SocketPath, Addr))
+        return -1;
+
+    int Conn = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (Conn < 0)
+        return -1;
+    if (connect(Conn, (sockaddr *)&Addr, sizeof(Addr)) != 0) {
+        close(Conn);
+        return -1;
+    }
+
+    std::vector<char> Cwd(4096);
+    while (!getcwd(Cwd.data(), Cwd.size()) && errno == ERANGE)
+        Cwd.resize(Cwd.size() * 2);
+
+    std::string Payload(Cwd.data());
+    Payload += '\0';
+    for (int i = 0; i < argc; i++) {
+        Payload += argv[i];
+        Payload += '\0';
+    }
+
+    uint32_t Size = Payload.size();
+    int Fds[NumFds] = {0, 1, 2};
+    char Control[CMSG_SPACE(sizeof(Fds))];
+    memset(Control, 0, sizeof(Control));
+    iovec Iov = {&Size, sizeof(Size)};
+    msghdr Msg;
+    memset(&Msg, 0, sizeof(Msg));
+    Msg.msg_iov = &Iov;
+    Msg.msg_iovlen = 1;
+    Msg.msg_control = Control;
+    Msg.msg_controllen = sizeof(Control);
+    cmsghdr *C = CMSG_FIRSTHDR(&Msg);
+    C->cmsg_level = SOL_SOCKET;
+    C->cmsg_type = SCM_RIGHTS;
+    C->cmsg_len = CMSG_LEN(sizeof(Fds));
+    memcpy(CMSG_DATA(C), Fds, sizeof(Fds));
+
+    int32_t Status;
+    if (sendmsg(Conn, &Msg, MSG_NOSIGNAL) != sizeof(Size) ||
+        !sendAll(Conn, Payload.data(), Payload.size()) ||
+        !readAll(Conn, &Status, sizeof(Status))) {
+        // The request may have run already; retrying locally is not safe.
+        fprintf(stderr, "p2: lost connection to server on %s\n", SocketPath.c_str());
+        Status = 1;
+    }
+    close(Conn);
+    return Status;
+}
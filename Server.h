@@ -0,0 +1,32 @@
+#ifndef P2_SERVER_H
+#define P2_SERVER_H
+
+#include <string>
+
+/* p2 as a long-lived daemon.
+ *
+ * The server process initializes LLVM once and then forks a child per
+ * request, so each optimization starts warm but with fresh options and
+ * statistics. A request carries the client's argv, its working directory
+ * and its stdin/stdout/stderr (passed as descriptors), so a child behaves
+ * exactly like a p2 started from the client's shell. The reply is p2's
+ * exit status, or 128 + signal if the child died.
+ *
+ * Nothing here depends on LLVM; the client links it without pulling LLVM
+ * in, which is what keeps it cheap to start.
+ * */
+
+/* $P2_SOCKET if set, otherwise /tmp/p2-<uid>.sock. */
+std::string p2SocketPath();
+
+/* Listens on SocketPath and runs Handler(argc, argv) in a forked child for
+ * every request. Only returns on error, with a non-zero exit code.
+ * */
+int serve(const std::string &SocketPath, int (*Handler)(int, char **));
+
+/* Forwards argv to the server at SocketPath and waits for its reply.
+ * Returns the remote exit status, or -1 if no server could be reached.
+ * */
+int sendRequest(const std::string &SocketPath, int argc, char **argv);
+
+#endif
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""Generate synthetic LLVM IR modules for stressing p2.
+
+Each function is a chain of straight-line basic blocks over a local array,
+so every block dominates the next and any earlier value may be reused.
+The knobs control module size and the kind of work p2 finds:
+
+  --functions N        functions per module
+  --blocks N           basic blocks per function
+  --block-size N       instructions per basic block
+  --mem-density F      fraction of instructions that are loads or stores
+  --store-ratio F      fraction of memory instructions that are stores
+  --redundancy F       fraction of instructions that repeat an earlier one
+                       (same opcode and operands), i.e. CSE/load-elim work
+  --seed N             random seed; output is deterministic per seed
+"""
+
+import argparse
+import random
+import sys
+
+ARITH = ['add', 'sub', 'mul', 'and', 'or', 'xor', 'shl', 'lshr']
+SLOTS = 64
+
+
+class FunctionGen(object):
+    def __init__(self, name, rng):
+        self.name = name
+        self.rng = rng
+        self.lines = []
+        self.values = ['%x', '%y']      # i32 values usable at this point
+        self.exprs = []                 # (text, result) of arithmetic so far
+        self.loads = []                 # (slot, result) loaded since last store
+        self.counter = 0
+
+    def fresh(self):
+        self.counter += 1
+        return '%%v%d' % self.counter
+
+    def operand(self):
+        if self.rng.random() < 0.2:
+            return str(self.rng.randint(1, 255))
+        return self.rng.choice(self.values)
+
+    def emit(self, text):
+        self.lines.append('  ' + text)
+
+    def slot_ptr(self, slot):
+        ptr = self.fresh()
+        self.emit('%s = getelementptr inbounds [%d x i32], [%d x i32]* %%mem, i64 0, i64 %d'
+                  % (ptr, SLOTS, SLOTS, slot))
+        return ptr
+
+    def load(self, redundant):
+        if redundant and self.loads:
+            slot = self.rng.choice(self.loads)[0]
+        else:
+            slot = self.rng.randrange(SLOTS)
+        ptr = self.slot_ptr(slot)
+        res = self.fresh()
+        self.emit('%s = load i32, i32* %s, align 4' % (res, ptr))
+        self.loads.append((slot, res))
+        self.values.append(res)
+
+    def store(self):
+        ptr = self.slot_ptr(self.rng.randrange(SLOTS))
+        self.emit('store i32 %s, i32* %s, align 4' % (self.rng.choice(self.values), ptr))
+        self.loads = []
+
+    def arith(self, redundant):
+        if redundant and self.exprs:
+            text = self.rng.choice(self.exprs)
+        else:
+            text = '%s i32 %s, %s' % (self.rng.choice(ARITH), self.operand(), self.operand())
+            self.exprs.append(text)
+        res = self.fresh()
+        self.emit('%s = %s' % (res, text))
+        self.values.append(res)
+
+    def generate(self, opts):
+        out = ['define i32 @%s(i32* %%p, i32 %%x, i32 %%y) {' % self.name, 'entry:',
+               '  %%mem = alloca [%d x i32], align 16' % SLOTS]
+        for b in range(opts.blocks):
+            self.lines = []
+            for _ in range(opts.block_size):
+                redundant = self.rng.random() < opts.redundancy
+                if self.rng.random() < opts.mem_density:
+                    if self.rng.random() < opts.store_ratio:
+                        self.store()
+                    else:
+                        self.load(redundant)
+                else:
+                    self.arith(redundant)
+            out.extend(self.lines)
+            if b + 1 < opts.blocks:
+                out.append('  br label %%bb%d' % (b + 1))
+                out.append('bb%d:' % (b + 1))
+            # loads are only known-equal within a block for p2
+            self.loads = []
+        out.append('  ret i32 %s' % self.values[-1])
+        out.append('}')
+        return out
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('--functions', type=int, default=10)
+    ap.add_argument('--blocks', type=int, default=4)
+    ap.add_argument('--block-size', type=int, default=50)
+    ap.add_argument('--mem-density', type=float, default=0.3)
+    ap.add_argument('--store-ratio', type=float, default=0.2)
+    ap.add_argument('--redundancy', type=float, default=0.2)
+    ap.add_argument('--seed', type=int, default=566)
+    ap.add_argument('-o', '--output', default='-')
+    opts = ap.parse_args()
+
+    rng = random.Random(opts.seed)
+    lines = ['; generated by gen_ir.py %s' % ' '.join(sys.argv[1:]),
+             'source_filename = "synthetic"', '']
+    for i in range(opts.functions):
+        lines.extend(FunctionGen('f%d' % i, rng).generate(opts))
+        lines.append('')
+
+    text = '\n'.join(lines)
+    if opts.output == '-':
+        sys.stdout.write(text)
+    else:
+        with open(opts.output, 'w') as f:
+            f.write(text)
+
+
+if __name__ == '__main__':
+    main()
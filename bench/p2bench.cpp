@@ -0,0 +1,314 @@
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/InstructionSimplify.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/LoopSimplify.h"
+#include "llvm/Transforms/Utils/Mem2Reg.h"
+
+#include "CSE.h"
+#include "ConstGlobals.h"
+#include "MergeFunctions.h"
+#include "Peephole.h"
+#include "PromoteGlobals.h"
+#include "SROA.h"
+
+using namespace llvm;
+
+/* p2bench: runs each p2 stage in isolation over fixed IR corpora.
+ *
+ *   p2bench [--benchmark_* flags] <corpus.ll|.bc> ...
+ *
+ * Every corpus is promoted with mem2reg once, as p2 -mem2reg would. Each
+ * iteration then clones the module, computes the analyses the stages use,
+ * and times only the stage itself across all functions. Besides the usual
+ * time per iteration, every benchmark reports ns/inst and allocs/inst,
+ * normalized by the number of instructions in the corpus.
+ * */
+
+/* Heap allocation counter. Only counts while Counting is set, which is
+ * only ever inside a timed stage; the benchmarks run on one thread. The
+ * link wraps malloc, calloc and realloc (see CMakeLists.txt), so direct
+ * calls such as SmallVector growth are counted along with operator new,
+ * which goes through malloc.
+ * */
+static bool Counting = false;
+static size_t Allocations = 0;
+
+extern "C" {
+void *__real_malloc(size_t Size);
+void *__real_calloc(size_t N, size_t Size);
+void *__real_realloc(void *P, size_t Size);
+
+void *__wrap_malloc(size_t Size) {
+    if (Counting)
+        Allocations++;
+    return __real_malloc(Size);
+}
+
+void *__wrap_calloc(size_t N, size_t Size) {
+    if (Counting)
+        Allocations++;
+    return __real_calloc(N, Size);
+}
+
+void *__wrap_realloc(void *P, size_t Size) {
+    if (Counting)
+        Allocations++;
+    return __real_realloc(P, Size);
+}
+}
+
+// libstdc++'s own operator new calls malloc from inside the shared
+// library, where the wrap does not reach.
+void *operator new(size_t Size) {
+    if (void *P = std::malloc(Size ? Size : 1))
+        return P;
+    throw std::bad_alloc();
+}
+
+// LLVM's allocate_buffer (DenseMap, StringMap, ...) uses the aligned form.
+void *operator new(size_t Size, std::align_val_t Align) {
+    if (Counting)
+        Allocations++;
+    size_t A = static_cast<size_t>(Align);
+    if (void *P = std::aligned_alloc(A, (Size + A - 1) / A * A))
+        return P;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *P) noexcept { std::free(P); }
+void operator delete(void *P, size_t) noexcept { std::free(P); }
+void operator delete(void *P, std::align_val_t) noexcept { std::free(P); }
+void operator delete(void *P, size_t, std::align_val_t) noexcept { std::free(P); }
+
+namespace {
+
+/* A stage takes a function whose analyses are already cached in FAM and
+ * returns true if it changed anything. Prepare, if set, runs untimed
+ * before that, for the canonicalization p2 runs ahead of the stage. New
+ * stages go in Stages below, module stages in ModuleStages.
+ * */
+struct Stage {
+    const char *Name;
+    bool (*Run)(Function &F, FunctionAnalysisManager &FAM);
+    void (*Prepare)(Function &F, FunctionAnalysisManager &FAM) = nullptr;
+};
+
+bool runBasic(Function &F, FunctionAnalysisManager &) {
+    return runCSEBasic(F, nullptr);
+}
+
+bool runSimplify(Function &F, FunctionAnalysisManager &FAM) {
+    SimplifyQuery Q(F.getParent()->getDataLayout(),
+                    &FAM.getResult<TargetLibraryAnalysis>(F),
+                    &FAM.getResult<DominatorTreeAnalysis>(F),
+                    &FAM.getResult<AssumptionAnalysis>(F));
+    return SimplifyInstructionPass(F, Q, nullptr);
+}
+
+bool runLoadElim(Function &F, FunctionAnalysisManager &FAM) {
+    return EliminatRedundantLoadPass(F, FAM.getResult<AAManager>(F), nullptr);
+}
+
+bool runPeepholeStage(Function &F, FunctionAnalysisManager &) {
+    return runPeephole(F, nullptr);
+}
+
+bool runSROAStage(Function &F, FunctionAnalysisManager &FAM) {
+    return runSROA(F, FAM.getResult<DominatorTreeAnalysis>(F),
+                   FAM.getResult<AssumptionAnalysis>(F), nullptr);
+}
+
+void loopSimplify(Function &F, FunctionAnalysisManager &FAM) {
+    FAM.invalidate(F, LoopSimplifyPass().run(F, FAM));
+    FAM.getResult<LoopAnalysis>(F);
+}
+
+bool runPromoteGlobalsStage(Function &F, FunctionAnalysisManager &FAM) {
+    return runPromoteLoopGlobals(F, FAM.getResult<LoopAnalysis>(F),
+                                 FAM.getResult<DominatorTreeAnalysis>(F),
+                                 FAM.getResult<AAManager>(F), nullptr);
+}
+
+const Stage Stages[] = {
+    {"basic", runBasic},
+    {"simplify", runSimplify},
+    {"ldelim", runLoadElim},
+    {"peephole", runPeepholeStage},
+    {"sroa", runSROAStage},
+    {"promote-globals", runPromoteGlobalsStage, loopSimplify},
+};
+
+/* Module stages see the whole module and need no cached analyses; they
+ * are timed once per clone rather than per function.
+ * */
+struct ModuleStage {
+    const char *Name;
+    bool (*Run)(Module &M);
+};
+
+bool runConstGlobalsStage(Module &M) {
+    return runConstantGlobals(M, {"main"});
+}
+
+const ModuleStage ModuleStages[] = {
+    {"mergefunc", mergeIdenticalFunctions},
+    {"const-globals", runConstGlobalsStage},
+};
+
+struct Corpus {
+    std::string Name;
+    std::unique_ptr<Module> M;
+    size_t Instructions = 0;
+};
+
+void computeAnalyses(Function &F, FunctionAnalysisManager &FAM) {
+    FAM.getResult<TargetLibraryAnalysis>(F);
+    FAM.getResult<DominatorTreeAnalysis>(F);
+    FAM.getResult<AssumptionAnalysis>(F);
+    FAM.getResult<AAManager>(F);
+}
+
+void reportCounters(benchmark::State &State, const Corpus &C, double Seconds, size_t Allocs) {
+    double Insts = double(C.Instructions) * State.iterations();
+    State.counters["insts"] = double(C.Instructions);
+    State.counters["ns/inst"] = Insts ? Seconds * 1e9 / Insts : 0;
+    State.counters["allocs/inst"] = Insts ? Allocs / Insts : 0;
+}
+
+void benchmarkStage(benchmark::State &State, const Stage &S, const Corpus &C) {
+    PassBuilder PB;
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    size_t Allocs = 0;
+    double Seconds = 0;
+    for (auto _ : State) {
+        std::unique_ptr<Module> M = CloneModule(*C.M);
+        for (Function &F : *M) {
+            if (F.isDeclaration())
+                continue;
+            if (S.Prepare)
+                S.Prepare(F, FAM);
+            computeAnalyses(F, FAM);
+        }
+
+        size_t Before = Allocations;
+        auto Start = std::chrono::steady_clock::now();
+        Counting = true;
+        for (Function &F : *M)
+            if (!F.isDeclaration())
+                benchmark::DoNotOptimize(S.Run(F, FAM));
+        Counting = false;
+        std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - Start;
+
+        State.SetIterationTime(Elapsed.count());
+        Seconds += Elapsed.count();
+        Allocs += Allocations - Before;
+
+        // The clone's functions die with it; drop their cached results.
+        FAM.clear();
+        MAM.clear();
+    }
+
+    reportCounters(State, C, Seconds, Allocs);
+}
+
+void benchmarkModuleStage(benchmark::State &State, const ModuleStage &S, const Corpus &C) {
+    size_t Allocs = 0;
+    double Seconds = 0;
+    for (auto _ : State) {
+        std::unique_ptr<Module> M = CloneModule(*C.M);
+
+        size_t Before = Allocations;
+        auto Start = std::chrono::steady_clock::now();
+        Counting = true;
+        benchmark::DoNotOptimize(S.Run(*M));
+        Counting = false;
+        std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - Start;
+
+        State.SetIterationTime(Elapsed.count());
+        Seconds += Elapsed.count();
+        Allocs += Allocations - Before;
+    }
+
+    reportCounters(State, C, Seconds, Allocs);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    benchmark::Initialize(&argc, argv);
+    if (argc < 2) {
+        errs() << "usage: " << argv[0] << " [--benchmark_* flags] <corpus> ...\n";
+        return 1;
+    }
+
+    LLVMContext Context;
+    std::vector<Corpus> Corpora;
+    for (int i = 1; i < argc; i++) {
+        SMDiagnostic Err;
+        Corpus C;
+        C.M = parseIRFile(argv[i], Err, Context);
+        if (!C.M) {
+            Err.print(argv[0], errs());
+            return 1;
+        }
+        C.Name = sys::path::stem(argv[i]).str();
+
+        // Start from what p2 -mem2reg hands to the CSE stages.
+        FunctionAnalysisManager FAM;
+        PassBuilder PB;
+        PB.registerFunctionAnalyses(FAM);
+        for (Function &F : *C.M) {
+            if (F.isDeclaration())
+                continue;
+            PromotePass().run(F, FAM);
+            C.Instructions += F.getInstructionCount();
+        }
+        Corpora.push_back(std::move(C));
+    }
+
+    for (const Corpus &C : Corpora)
+        for (const Stage &S : Stages)
+            benchmark::RegisterBenchmark((std::string(S.Name) + "/" + C.Name).c_str(),
+                                         benchmarkStage, S, std::cref(C))
+                ->UseManualTime()
+                ->Unit(benchmark::kMicrosecond);
+    for (const Corpus &C : Corpora)
+        for (const ModuleStage &S : ModuleStages)
+            benchmark::RegisterBenchmark((std::string(S.Name) + "/" + C.Name).c_str(),
+                                         benchmarkModuleStage, S, std::cref(C))
+                ->UseManualTime()
+                ->Unit(benchmark::kMicrosecond);
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
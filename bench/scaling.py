@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""Measure how p2's compile time and memory grow with module size.
+
+For each point of a sweep, generates a module with gen_ir.py, runs p2 on it
+and records wall time and peak RSS. One knob is swept at a time while the
+others stay at their defaults, so superlinear behaviour can be pinned on a
+dimension (e.g. --sweep block-size exposes per-block quadratic work, while
+--sweep functions should stay linear).
+
+Results go to <outdir>/scaling-<knob>.csv, plus a .png plot when matplotlib
+is available. The local growth exponent between successive points is
+printed; anything well above 1 is worth a look.
+"""
+
+import argparse
+import csv
+import math
+import os
+import subprocess
+import sys
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+SWEEPS = {
+    'functions':  [10, 20, 50, 100, 200, 500, 1000],
+    'blocks':     [1, 2, 5, 10, 20, 50, 100],
+    'block-size': [25, 50, 100, 200, 400, 800, 1600],
+}
+
+
+def count_instructions(path):
+    n = 0
+    with open(path) as f:
+        for line in f:
+            if line.startswith('  '):
+                n += 1
+    return n
+
+
+def run_p2(p2, args, ll, bc):
+    """Returns (seconds, peak RSS in KB) of one p2 run."""
+    start = time.perf_counter()
+    proc = subprocess.Popen([p2] + args + [ll, bc])
+    _, status, usage = os.wait4(proc.pid, 0)
+    elapsed = time.perf_counter() - start
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    if proc.returncode != 0:
+        sys.exit('p2 failed on %s (exit %d)' % (ll, proc.returncode))
+    return elapsed, usage.ru_maxrss
+
+
+def plot(rows, knob, png):
+    try:
+        import matplotlib
+        matplotlib.use('Agg')
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print('matplotlib not available, skipping %s' % png)
+        return
+
+    insts = [r['instructions'] for r in rows]
+    fig, ax1 = plt.subplots()
+    ax1.set_xscale('log')
+    ax1.set_yscale('log')
+    ax1.set_xlabel('instructions (sweeping %s)' % knob)
+    ax1.set_ylabel('p2 time (s)')
+    ax1.plot(insts, [r['seconds'] for r in rows], 'o-', color='tab:blue', label='time')
+    ax2 = ax1.twinx()
+    ax2.set_ylabel('peak RSS (MB)')
+    ax2.plot(insts, [r['maxrss_kb'] / 1024.0 for r in rows], 's--', color='tab:red', label='RSS')
+    fig.tight_layout()
+    fig.savefig(png)
+    print('wrote %s' % png)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__,
+                                 formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument('--p2', required=True, help='path to the p2 binary')
+    ap.add_argument('--sweep', choices=sorted(SWEEPS), default='block-size')
+    ap.add_argument('--points', type=int, default=None,
+                    help='only use the first N sizes of the sweep')
+    ap.add_argument('--repeat', type=int, default=3,
+                    help='runs per point; the fastest is reported')
+    ap.add_argument('--outdir', default='.')
+    ap.add_argument('--p2-args', default='-mem2reg',
+                    help='extra arguments passed to p2')
+    ap.add_argument('gen_args', nargs=argparse.REMAINDER,
+                    help='extra arguments for gen_ir.py (after --)')
+    opts = ap.parse_args()
+
+    gen_args = [a for a in opts.gen_args if a != '--']
+    p2_args = opts.p2_args.split()
+    sizes = SWEEPS[opts.sweep][:opts.points]
+    if not os.path.isdir(opts.outdir):
+        os.makedirs(opts.outdir)
+
+    rows = []
+    print('%10s %12s %10s %10s %8s' % (opts.sweep, 'instructions', 'time(s)', 'RSS(MB)', 'growth'))
+    for size in sizes:
+        ll = os.path.join(opts.outdir, 'scaling-%s-%d.ll' % (opts.sweep, size))
+        bc = ll[:-3] + '.bc'
+        subprocess.check_call([sys.executable, os.path.join(HERE, 'gen_ir.py'),
+                               '--' + opts.sweep, str(size), '-o', ll] + gen_args)
+
+        runs = [run_p2(opts.p2, p2_args, ll, bc) for _ in range(opts.repeat)]
+        row = {'size': size,
+               'instructions': count_instructions(ll),
+               'seconds': min(r[0] for r in runs),
+               'maxrss_kb': max(r[1] for r in runs)}
+
+        growth = ''
+        if rows:
+            prev = rows[-1]
+            growth = '%.2f' % (math.log(row['seconds'] / prev['seconds']) /
+                               math.log(float(row['instructions']) / prev['instructions']))
+        rows.append(row)
+        print('%10d %12d %10.4f %10.1f %8s' % (size, row['instructions'], row['seconds'],
+                                              row['maxrss_kb'] / 1024.0, growth))
+        for f in (ll, bc, bc + '.stats'):
+            if os.path.exists(f):
+                os.remove(f)
+
+    csvname = os.path.join(opts.outdir, 'scaling-%s.csv' % opts.sweep)
+    with open(csvname, 'w') as f:
+        w = csv.DictWriter(f, ['size', 'instructions', 'seconds', 'maxrss_kb'])
+        w.writeheader()
+        w.writerows(rows)
+    print('wrote %s' % csvname)
+    plot(rows, opts.sweep, csvname[:-4] + '.png')
+
+
+if __name__ == '__main__':
+    main()
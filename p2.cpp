@@ -10,31 +10,44 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/IR/LLVMRemarkStreamer.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/FileSystem.h"
-#include "llvm/IR/LegacyPassManager.h"
-#include "llvm/LinkAllPasses.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/SourceMgr.h"
-#include "llvm/Analysis/InstructionSimplify.h"
+#include "llvm/Transforms/Utils/LoopSimplify.h"
+#include "llvm/Transforms/Utils/Mem2Reg.h"
 
 #include "llvm/IR/InstIterator.h"
-#include "llvm/Transforms/Utils/FunctionComparator.h"
-#include "llvm/Transforms/InstCombine/InstCombiner.h"
 #include "llvm/IR/Value.h"
 
-using namespace llvm;
+#include "CSE.h"
+#include "CodeGen.h"
+#include "ConstGlobals.h"
+#include "FunctionCache.h"
+#include "MergeFunctions.h"
+#include "Peephole.h"
+#include "PromoteGlobals.h"
+#include "SROA.h"
+#include "Run.h"
+#include "Server.h"
 
+using namespace llvm;
 
-static void CommonSubexpressionElimination(Module *);
 
 static void summarize(Module *M);
+static void runCachedFunctionPipeline(Module &M, FunctionPassManager &FPM,
+                                      FunctionAnalysisManager &FAM);
 static void print_csv_file(std::string outputfile);
 
 static cl::opt<std::string>
@@ -43,27 +56,112 @@ static cl::opt<std::string>
 static cl::opt<std::string>
         OutputFilename(cl::Positional, cl::desc("<output bitcode>"), cl::Required, cl::init("out.bc"));
 
+static cl::opt<bool>
+        ConstGlobals("const-globals",
+                     cl::desc("Internalize all but the -export symbols and mark read-only globals constant before CSE."),
+                     cl::init(false));
+
+static cl::list<std::string>
+        Exports("export",
+                cl::desc("Symbol kept external by -const-globals (default: main)."),
+                cl::CommaSeparated);
+
+static cl::opt<bool>
+        ScalarRepl("sroa",
+                   cl::desc("Split small aggregate allocas into scalars and promote them before CSE."),
+                   cl::init(false));
+
 static cl::opt<bool>
         Mem2Reg("mem2reg",
                 cl::desc("Perform memory to register promotion before CSE."),
                 cl::init(false));
 
+static cl::opt<bool>
+        PromoteGlobals("promote-globals",
+                       cl::desc("Keep globals in registers inside loops that nothing else in the loop touches them in."),
+                       cl::init(false));
+
+static cl::opt<bool>
+        Peephole("peephole",
+                 cl::desc("Canonicalize expressions with the peephole combiner before CSE."),
+                 cl::init(false));
+
 static cl::opt<bool>
         NoCSE("no-cse",
               cl::desc("Do not perform CSE Optimization."),
               cl::init(false));
 
+static cl::opt<bool>
+        MergeFunc("mergefunc",
+                  cl::desc("Merge identical functions after CSE."),
+                  cl::init(false));
+
 static cl::opt<bool>
         Verbose("verbose",
                     cl::desc("Verbose stats."),
                     cl::init(false));
 
+static cl::opt<bool>
+        EmitObj("emit-obj",
+                cl::desc("Write a native object file instead of bitcode."),
+                cl::init(false));
+
+static cl::opt<bool>
+        Run("run",
+            cl::desc("JIT-compile the optimized module and time its main()."),
+            cl::init(false));
+
+static cl::opt<std::string>
+        RunArgs("run-args",
+                cl::desc("Arguments passed to main() in -run mode."),
+                cl::init(""));
+
+static cl::opt<std::string>
+        RunInput("run-input",
+                 cl::desc("File used as stdin in -run mode."),
+                 cl::init(""));
+
+static cl::opt<unsigned>
+        RunRepeat("run-repeat",
+                  cl::desc("Number of timed runs in -run mode."),
+                  cl::init(3));
+
+static cl::opt<std::string>
+        RunTimeFile("run-timefile",
+                    cl::desc("Write the fastest -run time here, in RunSafely.sh format."),
+                    cl::init(""));
+
+static cl::opt<std::string>
+        CacheDir("cache-dir",
+                 cl::desc("Reuse optimized functions cached in this directory."),
+                 cl::init(""));
+
+static cl::opt<std::string>
+        RemarksFilename("pass-remarks-output",
+                        cl::desc("Write optimization remarks for every transformation to this file."),
+                        cl::init(""));
+
+static cl::opt<std::string>
+        RemarksFormat("pass-remarks-format",
+                      cl::desc("Format of the remarks file (yaml or bitstream)."),
+                      cl::init("yaml"));
+
+static cl::opt<std::string>
+        RemarksPasses("pass-remarks-filter",
+                      cl::desc("Only record remarks from stages matching this regex, e.g. p2-cse-ldelim."),
+                      cl::init(""));
+
+static cl::opt<bool>
+        RemarksWithHotness("pass-remarks-with-hotness",
+                           cl::desc("Annotate remarks with profile hotness, when profile data is present."),
+                           cl::init(false));
+
 static cl::opt<bool>
         NoCheck("no",
                 cl::desc("Do not check for valid IR."),
                 cl::init(false));
 
-int main(int argc, char **argv) {
+static int optimize(int argc, char **argv) {
     // Parse command line arguments
     cl::ParseCommandLineOptions(argc, argv, "llvm system compiler\n");
 
@@ -92,16 +190,84 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    // Optimization remarks: every elimination, and every load we had to
+    // leave in place, with its source location when debug info is present.
+    Expected<std::unique_ptr<ToolOutputFile>> RemarksFile =
+        setupLLVMOptimizationRemarks(Context, RemarksFilename, RemarksPasses,
+                                     RemarksFormat, RemarksWithHotness);
+    if (!RemarksFile)
+    {
+        errs() << argv[0] << ": " << toString(RemarksFile.takeError()) << "\n";
+        return 1;
+    }
+
+    // Set up the new pass manager. Analyses (DominatorTree, MemorySSA, AA)
+    // are cached in the analysis managers and only recomputed when a stage
+    // fails to preserve them.
+    PassBuilder PB;
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    // Whole-program stage: runs first so that CSE folds the loads from
+    // globals it proves constant.
+    if (ConstGlobals)
+    {
+        std::vector<std::string> Exported(Exports.begin(), Exports.end());
+        if (Exported.empty())
+            Exported.push_back("main");
+        ModulePassManager MPM;
+        MPM.addPass(ConstantGlobalsPass(std::move(Exported)));
+        MPM.run(*M.get(), MAM);
+    }
+
+    FunctionPassManager FPM;
+
     // If requested, do some early optimizations
+    if (ScalarRepl)
+        FPM.addPass(ScalarReplAggregatesPass());
+
     if (Mem2Reg)
+        FPM.addPass(PromotePass());
+
+    // Promotion needs preheaders and dedicated exits to put the load and
+    // stores in.
+    if (PromoteGlobals)
     {
-        legacy::PassManager Passes;
-        Passes.add(createPromoteMemoryToRegisterPass());
-        Passes.run(*M.get());
+        FPM.addPass(LoopSimplifyPass());
+        FPM.addPass(PromoteLoopGlobalsPass());
     }
 
+    if (Peephole)
+        FPM.addPass(PeepholePass());
+
     if (!NoCSE) {
-        CommonSubexpressionElimination(M.get());
+        CommonSubexpressionElimination(FPM);
+    }
+
+    if (!CacheDir.empty())
+    {
+        runCachedFunctionPipeline(*M.get(), FPM, FAM);
+    }
+    else
+    {
+        ModulePassManager MPM;
+        MPM.addPass(createModuleToFunctionPassAdaptor(std::move(FPM)));
+        MPM.run(*M.get(), MAM);
+    }
+
+    // Module stages run on the CSE'd bodies, which compare equal more often
+    if (MergeFunc)
+    {
+        ModulePassManager MPM;
+        MPM.addPass(MergeIdenticalFunctionsPass());
+        MPM.run(*M.get(), MAM);
     }
 
     // Collect statistics on Module
@@ -114,18 +280,106 @@ int main(int argc, char **argv) {
     // Verify integrity of Module, do this by default
     if (!NoCheck)
     {
-        legacy::PassManager Passes;
-        Passes.add(createVerifierPass());
-        Passes.run(*M.get());
+        ModulePassManager Verify;
+        Verify.addPass(VerifierPass());
+        Verify.run(*M.get(), MAM);
     }
 
-    // Write final bitcode
-    WriteBitcodeToFile(*M.get(), Out->os());
+    if (EmitObj)
+    {
+        // Go straight to an object file, replacing the llc + as steps
+        std::string Error;
+        std::unique_ptr<TargetMachine> TM = createTargetMachine(*M.get(), Error);
+        if (!TM || !emitNativeCode(*M.get(), *TM, Out->os(), CGFT_ObjectFile, Error))
+        {
+            errs() << argv[0] << ": " << Error << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        // Write final bitcode
+        WriteBitcodeToFile(*M.get(), Out->os());
+    }
     Out->keep();
+    if (*RemarksFile)
+        (*RemarksFile)->keep();
+
+    if (Run)
+    {
+        RunOptions Opts;
+        SmallVector<StringRef, 8> Args;
+        SplitString(RunArgs, Args);
+        for (StringRef A : Args)
+            Opts.Args.push_back(A.str());
+        Opts.Input = RunInput;
+        Opts.TimeFile = RunTimeFile;
+        Opts.Repeat = RunRepeat;
+
+        int ExitCode = runModuleJIT(*M.get(), Opts);
+        return ExitCode < 0 ? 1 : ExitCode;
+    }
 
     return 0;
 }
 
+int main(int argc, char **argv) {
+    // p2 -serve <socket> stays resident and runs optimize() for each p2c
+    // request in a forked child, so requests skip process and LLVM startup.
+    if (argc == 3 && StringRef(argv[1]) == "-serve")
+    {
+        initializeNativeCodeGen();
+        return serve(argv[2], optimize);
+    }
+
+    return optimize(argc, argv);
+}
+
+static llvm::Statistic nCacheHits = {"", "CacheHits", "functions reused from the cache"};
+static llvm::Statistic nCacheMisses = {"", "CacheMisses", "functions optimized and cached"};
+
+// Remark pass name for cache hits and misses
+static const char *const CacheName = "p2-cache";
+
+static void runCachedFunctionPipeline(Module &M, FunctionPassManager &FPM,
+                                      FunctionAnalysisManager &FAM) {
+    /* Runs FPM function by function, reusing bodies from the -cache-dir
+     * cache when a function and everything it references are unchanged.
+     * The pipeline itself is part of every key. Hits and misses are
+     * reported as remarks, which unlike the statistics survive NDEBUG.
+     * */
+    std::string Pipeline;
+    raw_string_ostream OS(Pipeline);
+    FPM.printPipeline(OS, [](StringRef ClassName) { return ClassName; });
+    OS.flush();
+
+    FunctionCache Cache(M, CacheDir, Pipeline);
+    for (Function &F : M) {
+        if (F.isDeclaration())
+            continue;
+
+        std::string Key = Cache.getKey(F);
+        OptimizationRemarkEmitter ORE(&F);
+        if (Cache.restore(F, Key)) {
+            FAM.invalidate(F, PreservedAnalyses::none());
+            ORE.emit([&]() {
+                return OptimizationRemark(CacheName, "CacheHit", &F)
+                       << "reused the cached body of " << ore::NV("Function", &F);
+            });
+            nCacheHits++;
+            continue;
+        }
+
+        ORE.emit([&]() {
+            return OptimizationRemarkMissed(CacheName, "CacheMiss", &F)
+                   << ore::NV("Function", &F) << " not in the cache, optimized it";
+        });
+        FPM.run(F, FAM);
+        Cache.store(F, Key);
+        nCacheMisses++;
+    }
+}
+
 static llvm::Statistic nFunctions = {"", "Functions", "number of functions"};
 static llvm::Statistic nInstructions = {"", "Instructions", "number of instructions"};
 static llvm::Statistic nLoads = {"", "Loads", "number of loads"};
@@ -160,214 +414,3 @@ static void print_csv_file(std::string outputfile)
     }
     stats.close();
 }
-
-static llvm::Statistic CSEDead = {"", "CSEDead", "CSE found dead instructions"};
-static llvm::Statistic CSEElim = {"", "CSEElim", "CSE redundant instructions"};
-static llvm::Statistic CSESimplify = {"", "CSESimplify", "CSE simplified instructions"};
-static llvm::Statistic CSELdElim = {"", "CSELdElim", "CSE redundant loads"};
-static llvm::Statistic CSEStore2Load = {"", "CSEStore2Load", "CSE forwarded store to load"};
-static llvm::Statistic CSEStElim = {"", "CSEStElim", "CSE redundant stores"};
-
-
-static bool ignoreForCSE(Instruction &I){
-    /* Instruction is not a good candidate for CSE if they are of the following
-     * type: Loads, Stores, Terminators, VAArg, Calls, Allocas, and FCmps
-     */
-    if (isa<LoadInst>(&I) || isa<StoreInst>(&I) ||
-        isa<AllocaInst>(&I) || isa<FCmpInst>(&I) ||
-        isa<CallInst>(&I) || isa<VAArgInst>(&I)  ||
-        I.isTerminator()
-       ){
-        return true;
-    }
-
-    return false; 
-}
-
-static bool isLiteralMatch(Instruction &a, Instruction &b){
-    /* Remove IF:
-     * Same opcode
-     * Same type (LLVMTypeOf of the instruction not its operands)
-     * Same number of operands
-     * Same operands in the same order (no commutativity)
-     * */
-    if (a.getOpcode() == b.getOpcode() && a.getType() == b.getType() &&
-        a.getNumOperands() == b.getNumOperands()
-       ){
-
-        int c = a.getNumOperands() - 1;
-        while (c >= 0){
-            if (a.getOperand(c) != b.getOperand(c)) {return false;}
-            //if (a.getOperand(c)->getType() == b.getOperand(c)->getType()) {return false;}
-            //if (a.getOperand(c)->getValueID() == b.getOperand(c)->getValueID()) {return false;}
-            c--;
-        } 
-    	return true;
-    }
-    
-    return false;
-} 
-
-
-static bool shouldRemoveTrivialDeadCode(Instruction &x){
-    /* Similar to isTriviallyDeadInstruction
-     *
-     * Check whether instruction has any side effects
-     *
-     * Store / Volatie {load,store}/ Branch / Fence
-     * */
-    if (isa<CallInst>(&x) || x.mayHaveSideEffects() ||
-        x.isTerminator()
-       ){
-        return false;
-    }
-
-    if (x.use_empty()){
-        return true;
-    }
-
-    return false;
-}
-
-
-static void runCSEBasic(Module *M){
-    /**
-     * Runs the Basic CSE Pass 
-    /* Also Runs a non-aggresive Dead Code Elimination Pass
-     * 
-     * 
-     * 
-    DominatorTreeBase<BasicBlock,false> *DT=nullptr; //dominance
-    DominatorTreeBase<BasicBlock,true> *PDT=nullptr; //post-dominance
-
-    DT = new DominatorTreeBase<BasicBlock,false>();
-    PDT = new DominatorTreeBase<BasicBlock,true>();
-
-
-    DT->recalculate(*F); // F is Function*. Use one DominatorTreeBase and recalculate tree for each function you visit
-    PDT->recalculate(*F);
-
-    DomTreeNodeBase<BasicBlock> *Node = DT->getNode(bb); // get Node from some basic block*
-    DomTreeNodeBase<BasicBlock>::iterator it,end;
-    for(it=Node->begin(),end=Node->end(); it!=end; it++)
-    {
-        BasicBlock *bb_next = (*it)->getBlock(); // get each bb it immediately dominates
-    }
-     *
-     *
-     * */
-    for (Module::iterator func = M->begin(); func != M->end(); ++func){
-        for (Function::iterator fi = func->begin(); fi != func->end(); ++fi){
-            for (BasicBlock::iterator bbi = fi->begin(); bbi != fi->end(); ++bbi){
-                Instruction& inst = *bbi;
-                //if (ignoreForCSE(inst)){
-
-                //FIXME: when you fully flesh out CSE, ensure proper ordering
-                //since there is no way you can run CSE on deleted instruction
-                if (shouldRemoveTrivialDeadCode(inst)){
-                    //set the iterator
-                    ++bbi;
-                    //remove this instruction
-                    inst.eraseFromParent();
-                    CSEDead++;
-                }
-            }
-        }
-    }
-}
-
-
-static void RedundantLoadWorklist(Instruction &I, BasicBlock::iterator it, Function::iterator fi){
-    Instruction* load =  &I;
-
-    /*
-    printf("=================\n");
-    printf("\nConsidering all possible redloads for instruction: \n");
-    I.print(errs());
-    printf("\n");
-    */
-
-    ++it;  // increament the iterator, so that we start considering the immediate next instruction
-    for (; it != fi->end(); ++it){
-        Instruction* next_inst = &*it;
-        next_inst->print(errs());
-        //printf("\n");
-        if (isa<LoadInst>(next_inst) && !next_inst->isVolatile()){
-            if (isLiteralMatch(I, *next_inst)){
-                next_inst->replaceAllUsesWith(load);
-
-                it = next_inst->eraseFromParent();
-                CSELdElim++;
-            }
-        } else if (isa<StoreInst>(next_inst)){
-            break; 
-        }
-    }
-    //printf("=================\n");
-
-}
-
-static bool RunSimplifyInstruction(Instruction &I, const SimplifyQuery &Q){
-    /* Runs the simplifyInstruction library function
-     *
-     * If any simplification was achieved, it replaces the uses of this value
-     * */
-
-    Instruction *k;
-    k = &I;
-    Value* result = SimplifyInstruction(k, Q);
-    
-    if (result != nullptr) {
-        //replace uses with result
-        k->replaceAllUsesWith(result);
-        CSESimplify++;
-        return true;
-    }
-    //leave it be
-    return false;
-}
-
-static void SimplifyInstructionPass(Module *M){
-    /* Runs a pass where you try do simple constant folding and such things
-     *
-     * */
-    for (Module::iterator func = M->begin(); func != M->end(); ++func){
-        for (Function::iterator fi = func->begin(); fi != func->end(); ++fi){
-            for (BasicBlock::iterator bbi = fi->begin(); bbi != fi->end(); ++bbi){
-                Instruction& inst = *bbi;
-                if (RunSimplifyInstruction(inst, M->getDataLayout())){
-                    ++bbi;
-                    inst.eraseFromParent();
-                }
-            }
-        }
-    }
-}
-
-static void EliminatRedundantLoadPass(Module *M){
-    /* Examines a load and eliminates redundant loads within the same basic
-     * block
-     *
-     * */
-    for (Module::iterator func = M->begin(); func != M->end(); ++func){
-        for (Function::iterator fi = func->begin(); fi != func->end(); ++fi){
-            for (BasicBlock::iterator bbi = fi->begin(); bbi != fi->end(); ++bbi){
-            Instruction& inst = *bbi;
-            if (isa<LoadInst>(&inst)){
-                RedundantLoadWorklist(inst, bbi, fi);   
-                }
-            }
-        }
-    }
-}
-
-static void CommonSubexpressionElimination(Module *M) {
-    /* Driver function
-     * 
-     * Runs different optimization sub-passes in a certain order
-     * */
-
-    runCSEBasic(M);
-    SimplifyInstructionPass(M);
-    EliminatRedundantLoadPass(M);
-}
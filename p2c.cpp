@@ -0,0 +1,49 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "Server.h"
+
+/* p2c: a drop-in replacement for p2 as CUSTOMTOOL that hands the request
+ * to a running `p2 -serve` daemon instead of starting LLVM itself.
+ *
+ *   p2 -serve /tmp/p2.sock &
+ *   make CUSTOMTOOL=p2c P2_SOCKET=/tmp/p2.sock ...
+ *
+ * Arguments, working directory and stdio are forwarded untouched. With no
+ * server listening, p2c runs p2 directly ($P2, else the p2 next to p2c),
+ * unless P2_NO_FALLBACK is set.
+ * */
+
+static std::string siblingP2() {
+    char Self[4096];
+    ssize_t N = readlink("/proc/self/exe", Self, sizeof(Self) - 1);
+    if (N <= 0)
+        return "p2";
+    Self[N] = '\0';
+    std::string Path(Self);
+    return Path.substr(0, Path.rfind('/') + 1) + "p2";
+}
+
+int main(int argc, char **argv) {
+    std::string Socket = p2SocketPath();
+    int Status = sendRequest(Socket, argc, argv);
+    if (Status >= 0)
+        return Status;
+
+    if (getenv("P2_NO_FALLBACK")) {
+        fprintf(stderr, "p2c: no p2 server on %s\n", Socket.c_str());
+        return 1;
+    }
+
+    std::string P2 = getenv("P2") ? getenv("P2") : siblingP2();
+    argv[0] = &P2[0];
+    execv(P2.c_str(), argv);
+    execvp("p2", argv);
+    fprintf(stderr, "p2c: cannot run %s: %s\n", P2.c_str(), strerror(errno));
+    return 127;
+}
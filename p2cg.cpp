@@ -0,0 +1,206 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+#include "CodeGen.h"
+
+using namespace llvm;
+
+/* p2cg: a CUSTOMCODEGEN-compatible backend that splits a module along
+ * function boundaries and runs the code generator on each partition in its
+ * own thread.
+ *
+ *   p2cg [-j N] [-partitions P] <input bitcode> <output>
+ *
+ * An output ending in .s gets assembly for the whole module (partitions
+ * cannot be concatenated as assembly, their private labels collide).
+ * Anything else gets a single relocatable object, made by compiling the P
+ * partitions and combining them with ld -r in partition order.
+ *
+ * The partitioning depends only on the module and P, never on -j, so the
+ * object is byte-for-byte the same whether it was built on one thread or
+ * many.
+ * */
+
+static cl::opt<std::string>
+        InputFilename(cl::Positional, cl::desc("<input bitcode>"), cl::Required, cl::init("-"));
+
+static cl::opt<std::string>
+        OutputFilename(cl::Positional, cl::desc("<output object or .s>"), cl::Required, cl::init("out.o"));
+
+static cl::opt<unsigned>
+        Threads("j",
+                cl::desc("Number of code generation threads (0 = all cores)."),
+                cl::init(0));
+
+static cl::opt<unsigned>
+        Partitions("partitions",
+                   cl::desc("Number of partitions to split the module into."),
+                   cl::init(8));
+
+static cl::opt<std::string>
+        Linker("ld",
+               cl::desc("Linker used to combine partition objects."),
+               cl::init("ld"));
+
+static bool codegenSerial(Module &M, CodeGenFileType FileType, const char *argv0) {
+    std::error_code EC;
+    ToolOutputFile Out(OutputFilename, EC,
+                       FileType == CGFT_AssemblyFile ? sys::fs::OF_Text : sys::fs::OF_None);
+    if (EC) {
+        errs() << argv0 << ": " << EC.message() << "\n";
+        return false;
+    }
+
+    std::string Error;
+    std::unique_ptr<TargetMachine> TM = createTargetMachine(M, Error);
+    if (!TM || !emitNativeCode(M, *TM, Out.os(), FileType, Error)) {
+        errs() << argv0 << ": " << Error << "\n";
+        return false;
+    }
+    Out.keep();
+    return true;
+}
+
+static bool compilePartition(StringRef Bitcode, SmallVectorImpl<char> &Object,
+                             std::string &Error) {
+    /* Runs on a worker thread. Every partition gets its own context, so
+     * the threads share nothing but the (immutable) target registry.
+     * */
+    LLVMContext Context;
+    Expected<std::unique_ptr<Module>> MPart =
+        parseBitcodeFile(MemoryBufferRef(Bitcode, "<partition>"), Context);
+    if (!MPart) {
+        Error = toString(MPart.takeError());
+        return false;
+    }
+
+    std::unique_ptr<TargetMachine> TM = createTargetMachine(**MPart, Error);
+    if (!TM)
+        return false;
+
+    raw_svector_ostream OS(Object);
+    return emitNativeCode(**MPart, *TM, OS, CGFT_ObjectFile, Error);
+}
+
+static bool codegenParallel(Module &M, const char *argv0) {
+    // Split on the main thread; SplitModule hands partitions back in order.
+    std::vector<SmallString<0>> Bitcodes;
+    SplitModule(M, Partitions, [&](std::unique_ptr<Module> MPart) {
+        Bitcodes.emplace_back();
+        raw_svector_ostream BCOS(Bitcodes.back());
+        WriteBitcodeToFile(*MPart, BCOS);
+    });
+
+    std::vector<SmallString<0>> Objects(Bitcodes.size());
+    std::vector<std::string> Errors(Bitcodes.size());
+    std::vector<char> Ok(Bitcodes.size(), 0);
+    {
+        ThreadPool Pool(hardware_concurrency(Threads));
+        for (unsigned i = 0; i < Bitcodes.size(); i++) {
+            Pool.async([&, i]() {
+                Ok[i] = compilePartition(Bitcodes[i], Objects[i], Errors[i]);
+            });
+        }
+        Pool.wait();
+    }
+
+    for (unsigned i = 0; i < Bitcodes.size(); i++) {
+        if (!Ok[i]) {
+            errs() << argv0 << ": partition " << i << ": " << Errors[i] << "\n";
+            return false;
+        }
+    }
+
+    // Write the partition objects out and combine them, in partition order.
+    std::vector<std::string> Temps;
+    bool Success = true;
+    for (unsigned i = 0; i < Objects.size() && Success; i++) {
+        SmallString<128> Path;
+        int FD;
+        if (sys::fs::createTemporaryFile("p2cg", "o", FD, Path)) {
+            errs() << argv0 << ": could not create temporary file\n";
+            Success = false;
+            break;
+        }
+        raw_fd_ostream OS(FD, /*shouldClose=*/true);
+        OS << Objects[i];
+        Temps.push_back(std::string(Path.str()));
+    }
+
+    if (Success) {
+        ErrorOr<std::string> LD = sys::findProgramByName(Linker);
+        if (!LD) {
+            errs() << argv0 << ": cannot find linker '" << Linker << "'\n";
+            Success = false;
+        } else {
+            std::vector<StringRef> Args = {*LD, "-r", "-o", OutputFilename};
+            for (const std::string &T : Temps)
+                Args.push_back(T);
+
+            std::string ErrMsg;
+            if (sys::ExecuteAndWait(*LD, Args, None, {}, 0, 0, &ErrMsg) != 0) {
+                errs() << argv0 << ": " << *LD << " -r failed";
+                if (!ErrMsg.empty())
+                    errs() << ": " << ErrMsg;
+                errs() << "\n";
+                Success = false;
+            }
+        }
+    }
+
+    for (const std::string &T : Temps)
+        sys::fs::remove(T);
+    return Success;
+}
+
+int main(int argc, char **argv) {
+    // Parse command line arguments
+    cl::ParseCommandLineOptions(argc, argv, "p2 parallel code generator\n");
+
+    // Handle creating output files and shutting down properly
+    llvm_shutdown_obj Y;  // Call llvm_shutdown() on exit.
+    LLVMContext Context;
+
+    // Read in module
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M = parseIRFile(InputFilename, Err, Context);
+
+    // If errors, fail
+    if (M.get() == 0)
+    {
+        Err.print(argv[0], errs());
+        return 1;
+    }
+
+    initializeNativeCodeGen();
+
+    bool Success;
+    if (StringRef(OutputFilename).endswith(".s"))
+        Success = codegenSerial(*M, CGFT_AssemblyFile, argv[0]);
+    else if (Partitions <= 1)
+        Success = codegenSerial(*M, CGFT_ObjectFile, argv[0]);
+    else
+        Success = codegenParallel(*M, argv[0]);
+
+    return Success ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+; p2cg splits this module into partitions; the object must not depend on
+; how many threads compiled them. The PIC/PIE flags are the ones clang
+; records by default; they make p2cg emit PIC, so the object links into a
+; PIE with the system compiler's default settings.
+source_filename = "codegen0"
+
+@.str = private unnamed_addr constant [4 x i8] c"%d\0A\00", align 1
+@table = internal global [4 x i32] [i32 3, i32 1, i32 4, i32 1], align 16
+
+declare i32 @printf(i8*, ...)
+
+define internal i32 @lookup(i32 %i) {
+BB:
+  %idx = sext i32 %i to i64
+  %p = getelementptr [4 x i32], [4 x i32]* @table, i64 0, i64 %idx
+  %v = load i32, i32* %p, align 4
+  ret i32 %v
+}
+
+define i32 @sum(i32 %n) {
+BB:
+  br label %Loop
+
+Loop:
+  %i = phi i32 [ 0, %BB ], [ %i1, %Loop ]
+  %s = phi i32 [ 0, %BB ], [ %s1, %Loop ]
+  %m = and i32 %i, 3
+  %v = call i32 @lookup(i32 %m)
+  %s1 = add i32 %s, %v
+  %i1 = add i32 %i, 1
+  %c = icmp slt i32 %i1, %n
+  br i1 %c, label %Loop, label %Exit
+
+Exit:
+  ret i32 %s1
+}
+
+define i32 @twice(i32 %x) {
+BB:
+  %y = shl i32 %x, 1
+  ret i32 %y
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+BB:
+  %s = call i32 @sum(i32 100)
+  %t = call i32 @twice(i32 %s)
+  %r = call i32 (i8*, ...) @printf(i8* getelementptr ([4 x i8], [4 x i8]* @.str, i64 0, i64 0), i32 %t)
+  ret i32 0
+}
+
+!llvm.module.flags = !{!0, !1}
+!0 = !{i32 7, !"PIC Level", i32 2}
+!1 = !{i32 7, !"PIE Level", i32 2}
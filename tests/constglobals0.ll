@@ -0,0 +1,72 @@
+; ModuleID = 'constglobals0'
+; CHECK-LABEL: source_filename = "constglobals0"
+source_filename = "constglobals0"
+
+; Only ever loaded: becomes a constant, and the loads fold away.
+; CHECK: @size = internal constant i32 64
+@size = global i32 64, align 4
+; CHECK: @table = internal constant [4 x i32] [i32 1, i32 2, i32 4, i32 8]
+@table = global [4 x i32] [i32 1, i32 2, i32 4, i32 8], align 16
+; Stored to: internalized, but still writable.
+; CHECK: @counter = internal global i32 0
+@counter = global i32 0, align 4
+; Its address escapes into a call: left writable.
+; CHECK: @escaped = internal global i32 5
+@escaped = global i32 5, align 4
+; Volatile loads must keep reading memory.
+; CHECK: @flag = internal global i32 1
+@flag = global i32 1, align 4
+
+declare void @use(i32*)
+
+; CHECK-LABEL: define internal i32 @scale(i32 %x)
+; CHECK-NOT: load
+; CHECK: mul i32 %x, 64
+define i32 @scale(i32 %x) {
+entry:
+  %s = load i32, i32* @size, align 4
+  %r = mul i32 %x, %s
+  ret i32 %r
+}
+
+; CHECK-LABEL: define internal i32 @lookup(i64 %i)
+; CHECK: getelementptr
+; CHECK: load i32
+define i32 @lookup(i64 %i) {
+entry:
+  %p = getelementptr inbounds [4 x i32], [4 x i32]* @table, i64 0, i64 %i
+  %v = load i32, i32* %p, align 4
+  ret i32 %v
+}
+
+; CHECK-LABEL: define internal i32 @third()
+; CHECK-NOT: load
+; CHECK: ret i32 4
+define i32 @third() {
+entry:
+  %v = load i32, i32* getelementptr inbounds ([4 x i32], [4 x i32]* @table, i64 0, i64 2), align 8
+  ret i32 %v
+}
+
+; CHECK-LABEL: define internal void @bump()
+define void @bump() {
+entry:
+  %c = load i32, i32* @counter, align 4
+  %c1 = add i32 %c, 1
+  store i32 %c1, i32* @counter, align 4
+  call void @use(i32* @escaped)
+  %f = load volatile i32, i32* @flag, align 4
+  ret void
+}
+
+; CHECK-LABEL: define i32 @main()
+define i32 @main() {
+entry:
+  call void @bump()
+  %a = call i32 @scale(i32 3)
+  %b = call i32 @lookup(i64 1)
+  %c = call i32 @third()
+  %s = add i32 %a, %b
+  %t = add i32 %s, %c
+  ret i32 %t
+}
@@ -0,0 +1,91 @@
+; ModuleID = 'merge0'
+; CHECK-LABEL: source_filename = "merge0"
+source_filename = "merge0"
+
+; CHECK: @unnamed2 = unnamed_addr alias i32 (i32), i32 (i32)* @unnamed1
+
+; CHECK-LABEL: define internal i32 @local1(i32 %0)
+define internal i32 @local1(i32 %0) {
+  %2 = mul i32 %0, %0
+  %3 = add i32 %2, 7
+  ret i32 %3
+}
+
+; Only called directly, so it goes away entirely.
+; CHECK-NOT: @local2
+define internal i32 @local2(i32 %0) {
+  %2 = mul i32 %0, %0
+  %3 = add i32 %2, 7
+  ret i32 %3
+}
+
+; CHECK-LABEL: define i32 @caller(i32 %0)
+; CHECK-NEXT: call i32 @local1(i32 %0)
+; CHECK-NEXT: call i32 @local1(i32 %0)
+define i32 @caller(i32 %0) {
+  %2 = call i32 @local1(i32 %0)
+  %3 = call i32 @local2(i32 %0)
+  %4 = add i32 %2, %3
+  ret i32 %4
+}
+
+; CHECK-LABEL: define i64 @exported1(i64 %0, i64 %1)
+define i64 @exported1(i64 %0, i64 %1) {
+  %3 = shl i64 %0, 3
+  %4 = xor i64 %3, %1
+  ret i64 %4
+}
+
+; Visible and address-significant: keeps its name, becomes a thunk.
+; CHECK-LABEL: define i64 @exported2(i64 %0, i64 %1)
+; CHECK-NEXT: tail call i64 @exported1(i64 %0, i64 %1)
+; CHECK-NEXT: ret i64
+define i64 @exported2(i64 %0, i64 %1) {
+  %3 = shl i64 %0, 3
+  %4 = xor i64 %3, %1
+  ret i64 %4
+}
+
+; CHECK-LABEL: define i32 @unnamed1(i32 %0)
+define i32 @unnamed1(i32 %0) unnamed_addr {
+  %2 = sub i32 0, %0
+  ret i32 %2
+}
+
+define i32 @unnamed2(i32 %0) unnamed_addr {
+  %2 = sub i32 0, %0
+  ret i32 %2
+}
+
+; Same shape, different constant: not merged.
+; CHECK-LABEL: define i32 @different(i32 %0)
+; CHECK-NEXT: sub i32 1, %0
+define i32 @different(i32 %0) unnamed_addr {
+  %2 = sub i32 1, %0
+  ret i32 %2
+}
+
+; A comdat copy may be discarded at link time, taking any alias to it
+; along: neither function is merged.
+; CHECK-LABEL: define linkonce_odr i32 @inline1(i32 %0) unnamed_addr comdat
+; CHECK-NEXT: add i32 %0, 42
+$inline1 = comdat any
+define linkonce_odr i32 @inline1(i32 %0) unnamed_addr comdat {
+  %2 = add i32 %0, 42
+  ret i32 %2
+}
+
+; CHECK-LABEL: define i32 @strong(i32 %0) unnamed_addr
+; CHECK-NEXT: add i32 %0, 42
+define i32 @strong(i32 %0) unnamed_addr {
+  %2 = add i32 %0, 42
+  ret i32 %2
+}
+
+; Plain weak_odr without a comdat is still replaceable.
+; CHECK-LABEL: define weak_odr i32 @weak1(i32 %0) unnamed_addr
+; CHECK-NEXT: add i32 %0, 42
+define weak_odr i32 @weak1(i32 %0) unnamed_addr {
+  %2 = add i32 %0, 42
+  ret i32 %2
+}
@@ -0,0 +1,55 @@
+; ModuleID = 'peephole0'
+; CHECK-LABEL: source_filename = "peephole0"
+source_filename = "peephole0"
+
+; CHECK-LABEL: @reassoc(i32 %0)
+; CHECK-NEXT: %2 = mul i32 %0, 12
+; CHECK-NEXT: %3 = add i32 %2, -8
+; CHECK-NEXT: ret i32 %3
+define i32 @reassoc(i32 %0) {
+  %2 = mul i32 3, %0
+  %3 = mul i32 %2, 4
+  %4 = sub i32 %3, 3
+  %5 = sub i32 %4, 5
+  ret i32 %5
+}
+
+; CHECK-LABEL: @shifts(i32 %0)
+; CHECK-NEXT: %2 = shl i32 %0, 5
+; CHECK-NEXT: %3 = and i32 %0, 268435455
+; CHECK-NEXT: %4 = add i32 %2, %3
+; CHECK-NEXT: ret i32 %4
+define i32 @shifts(i32 %0) {
+  %2 = mul i32 %0, 4
+  %3 = shl i32 %2, 3
+  %4 = shl i32 %0, 4
+  %5 = lshr i32 %4, 4
+  %6 = add i32 %3, %5
+  ret i32 %6
+}
+
+; CHECK-LABEL: @compares(i32 %0, i32 %1)
+; CHECK-NEXT: %3 = icmp sgt i32 %0, 9
+; CHECK-NEXT: %4 = icmp ult i32 %0, 100
+; CHECK-NEXT: %5 = and i1 %3, %4
+; CHECK-NEXT: %6 = icmp eq i32 %0, %1
+; CHECK-NEXT: %7 = or i1 %5, %6
+; CHECK-NEXT: ret i1 %7
+define i1 @compares(i32 %0, i32 %1) {
+  %3 = icmp sle i32 10, %0
+  %4 = icmp ule i32 %0, 99
+  %5 = and i1 %3, %4
+  %6 = sub i32 %0, %1
+  %7 = icmp eq i32 %6, 0
+  %8 = or i1 %5, %7
+  ret i1 %8
+}
+
+; Shifting out every bit leaves zero.
+; CHECK-LABEL: @shiftout(i32 %0)
+; CHECK-NEXT: ret i32 0
+define i32 @shiftout(i32 %0) {
+  %2 = lshr i32 %0, 20
+  %3 = lshr i32 %2, 12
+  ret i32 %3
+}
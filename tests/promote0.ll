@@ -0,0 +1,135 @@
+; ModuleID = 'promote0'
+; CHECK-LABEL: source_filename = "promote0"
+source_filename = "promote0"
+
+@count = global i32 0, align 4
+@head = global i32* null, align 8
+@limit = global i32 100, align 4
+@table = global [4 x i32] zeroinitializer, align 4
+
+; while (i < limit) { count++; i++; }  The header can leave before any
+; store, so the store after the loop only happens if the loop stored.
+; CHECK-LABEL: @counter()
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %limit.promoted = load i32, i32* @limit
+; CHECK-NEXT: %count.promoted = load i32, i32* @count
+; CHECK: %count.stored = phi i1 [ false, %entry ], [ true, %body ]
+; CHECK: %count = phi i32 [ %count.promoted, %entry ], [ %c1, %body ]
+; CHECK-NOT: @count
+; CHECK: exit:
+; CHECK-NEXT: br i1 %count.stored
+; CHECK: store i32 %count, i32* @count
+; CHECK-NEXT: br label
+define void @counter() {
+entry:
+  br label %cond
+
+cond:
+  %i = phi i32 [ 0, %entry ], [ %inc, %body ]
+  %lim = load i32, i32* @limit, align 4
+  %cmp = icmp slt i32 %i, %lim
+  br i1 %cmp, label %body, label %exit
+
+body:
+  %c = load i32, i32* @count, align 4
+  %c1 = add i32 %c, 1
+  store i32 %c1, i32* @count, align 4
+  %inc = add i32 %i, 1
+  br label %cond
+
+exit:
+  ret void
+}
+
+; do { count += *p; } while (--n);  Every trip stores, so the store after
+; the loop is unconditional.
+; CHECK-LABEL: @summer(i32* noalias %p, i32 %n)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: %count.promoted = load i32, i32* @count
+; CHECK-NOT: @count
+; CHECK: exit:
+; CHECK-NEXT: store i32 %c1, i32* @count
+; CHECK-NEXT: ret void
+define void @summer(i32* noalias %p, i32 %n) {
+entry:
+  br label %body
+
+body:
+  %k = phi i32 [ %n, %entry ], [ %dec, %body ]
+  %v = load i32, i32* %p, align 4
+  %c = load i32, i32* @count, align 4
+  %c1 = add i32 %c, %v
+  store i32 %c1, i32* @count, align 4
+  %dec = add i32 %k, -1
+  %more = icmp ne i32 %dec, 0
+  br i1 %more, label %body, label %exit
+
+exit:
+  ret void
+}
+
+; The call may read or write @count, so nothing is promoted.
+; CHECK-LABEL: @calls(i32 %n)
+; CHECK: body:
+; CHECK: load i32, i32* @count
+; CHECK: store i32 %c1, i32* @count
+define void @calls(i32 %n) {
+entry:
+  br label %body
+
+body:
+  %k = phi i32 [ %n, %entry ], [ %dec, %body ]
+  %c = load i32, i32* @count, align 4
+  %c1 = add i32 %c, 1
+  store i32 %c1, i32* @count, align 4
+  call void @external()
+  %dec = add i32 %k, -1
+  %more = icmp ne i32 %dec, 0
+  br i1 %more, label %body, label %exit
+
+exit:
+  ret void
+}
+
+; if (n > 4) table[4]++;  in a loop. table[4] is past the end: loading it
+; in the preheader would be UB even when the guard never holds, so it is
+; left alone. table[1] is in bounds and promoted.
+; CHECK-LABEL: @bounds(i32 %n)
+; CHECK-NEXT: entry:
+; CHECK-NEXT: load i32, i32* getelementptr inbounds ([4 x i32], [4 x i32]* @table, i64 0, i64 1)
+; CHECK-NOT: load
+; CHECK: guarded:
+; CHECK-NEXT: %e = load i32, i32* getelementptr
+; CHECK-NEXT: add
+; CHECK-NEXT: store i32 %e1, i32* getelementptr
+; CHECK: exit:
+; CHECK-NEXT: store i32 %t1, i32* getelementptr inbounds ([4 x i32], [4 x i32]* @table, i64 0, i64 1)
+; CHECK-NEXT: ret void
+define void @bounds(i32 %n) {
+entry:
+  br label %body
+
+body:
+  %k = phi i32 [ %n, %entry ], [ %dec, %latch ]
+  %t = load i32, i32* getelementptr inbounds ([4 x i32], [4 x i32]* @table, i64 0, i64 1), align 4
+  %t1 = add i32 %t, 1
+  store i32 %t1, i32* getelementptr inbounds ([4 x i32], [4 x i32]* @table, i64 0, i64 1), align 4
+  %big = icmp sgt i32 %n, 4
+  br i1 %big, label %guarded, label %latch
+
+guarded:
+  %e = load i32, i32* getelementptr ([4 x i32], [4 x i32]* @table, i64 0, i64 4), align 4
+  %e1 = add i32 %e, 1
+  store i32 %e1, i32* getelementptr ([4 x i32], [4 x i32]* @table, i64 0, i64 4), align 4
+  br label %latch
+
+latch:
+  %dec = add i32 %k, -1
+  %more = icmp ne i32 %dec, 0
+  br i1 %more, label %body, label %exit
+
+exit:
+  ret void
+}
+
+declare void @external()
@@ -0,0 +1,115 @@
+; ModuleID = 'sroa0'
+; CHECK-LABEL: source_filename = "sroa0"
+source_filename = "sroa0"
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+
+%struct.point = type { double, double }
+%struct.pair = type { i32, i32 }
+%struct.box = type { i64 }
+
+; A struct and a nested array, only touched element by element: both
+; disappear and the values stay in registers.
+; CHECK-LABEL: @dist2(double %0, double %1)
+; CHECK-NOT: alloca
+; CHECK-NOT: load
+; CHECK-NOT: store
+; CHECK: fmul double %0, %0
+; CHECK: fmul double %1, %1
+; CHECK: ret double
+define double @dist2(double %0, double %1) {
+  %p = alloca %struct.point, align 8
+  %v = alloca [2 x [2 x double]], align 16
+  %3 = bitcast %struct.point* %p to i8*
+  call void @llvm.lifetime.start.p0i8(i64 16, i8* %3)
+  %x = getelementptr inbounds %struct.point, %struct.point* %p, i32 0, i32 0
+  store double %0, double* %x, align 8
+  %y = getelementptr inbounds %struct.point, %struct.point* %p, i32 0, i32 1
+  store double %1, double* %y, align 8
+  %row = getelementptr inbounds [2 x [2 x double]], [2 x [2 x double]]* %v, i64 0, i64 1
+  %e0 = getelementptr inbounds [2 x double], [2 x double]* %row, i64 0, i64 0
+  %e1 = getelementptr inbounds [2 x [2 x double]], [2 x [2 x double]]* %v, i64 0, i64 1, i64 1
+  %4 = load double, double* %x, align 8
+  %5 = fmul double %4, %4
+  store double %5, double* %e0, align 16
+  %6 = load double, double* %y, align 8
+  %7 = fmul double %6, %6
+  store double %7, double* %e1, align 8
+  %8 = load double, double* %e0, align 16
+  %9 = load double, double* %e1, align 8
+  %10 = fadd double %8, %9
+  call void @llvm.lifetime.end.p0i8(i64 16, i8* %3)
+  ret double %10
+}
+
+; Passed to a call and indexed by a variable: both stay in memory.
+; CHECK-LABEL: @escapes(i64 %0)
+; CHECK-NEXT: %a = alloca [4 x i32]
+; CHECK-NEXT: %b = alloca [4 x i32]
+define i32 @escapes(i64 %0) {
+  %a = alloca [4 x i32], align 16
+  %b = alloca [4 x i32], align 16
+  %2 = getelementptr inbounds [4 x i32], [4 x i32]* %a, i64 0, i64 0
+  call void @fill(i32* %2)
+  %3 = getelementptr inbounds [4 x i32], [4 x i32]* %b, i64 0, i64 %0
+  store i32 1, i32* %3, align 4
+  %4 = load i32, i32* %2, align 4
+  ret i32 %4
+}
+
+; With -g the variable survives the split: each element gets a fragment of
+; it, which mem2reg turns into dbg.values. A one-element aggregate takes
+; the whole variable, since a fragment may not cover all of it.
+; CHECK-LABEL: @debug(i32 %0, i64 %1)
+; CHECK-NOT: alloca
+; CHECK: call void @llvm.dbg.value(metadata i32 %0, metadata ![[PAIR:[0-9]+]], metadata !DIExpression(DW_OP_LLVM_fragment, 0, 32))
+; CHECK: call void @llvm.dbg.value(metadata i32 %0, metadata ![[PAIR]], metadata !DIExpression(DW_OP_LLVM_fragment, 32, 32))
+; CHECK: call void @llvm.dbg.value(metadata i64 %1, metadata ![[BOX:[0-9]+]], metadata !DIExpression())
+; CHECK-NOT: dbg.declare
+; CHECK: ret i32
+; CHECK-DAG: ![[PAIR]] = !DILocalVariable(name: "pr"
+; CHECK-DAG: ![[BOX]] = !DILocalVariable(name: "box"
+define i32 @debug(i32 %0, i64 %1) !dbg !5 {
+  %pr = alloca %struct.pair, align 4
+  %box = alloca %struct.box, align 8
+  call void @llvm.dbg.declare(metadata %struct.pair* %pr, metadata !10, metadata !DIExpression()), !dbg !15
+  call void @llvm.dbg.declare(metadata %struct.box* %box, metadata !16, metadata !DIExpression()), !dbg !15
+  %a = getelementptr inbounds %struct.pair, %struct.pair* %pr, i32 0, i32 0
+  store i32 %0, i32* %a, align 4, !dbg !15
+  %b = getelementptr inbounds %struct.pair, %struct.pair* %pr, i32 0, i32 1
+  store i32 %0, i32* %b, align 4, !dbg !15
+  %c = getelementptr inbounds %struct.box, %struct.box* %box, i32 0, i32 0
+  store i64 %1, i64* %c, align 8, !dbg !15
+  %3 = load i32, i32* %a, align 4, !dbg !15
+  %4 = load i32, i32* %b, align 4, !dbg !15
+  %5 = add i32 %3, %4, !dbg !15
+  ret i32 %5, !dbg !15
+}
+
+declare void @fill(i32*)
+declare void @llvm.lifetime.start.p0i8(i64, i8* nocapture)
+declare void @llvm.lifetime.end.p0i8(i64, i8* nocapture)
+declare void @llvm.dbg.declare(metadata, metadata, metadata)
+
+!llvm.dbg.cu = !{!0}
+!llvm.module.flags = !{!3, !4}
+
+!0 = distinct !DICompileUnit(language: DW_LANG_C99, file: !1, producer: "clang", isOptimized: false, runtimeVersion: 0, emissionKind: FullDebug, enums: !2)
+!1 = !DIFile(filename: "sroa0.c", directory: "/tmp")
+!2 = !{}
+!3 = !{i32 2, !"Debug Info Version", i32 3}
+!4 = !{i32 7, !"Dwarf Version", i32 4}
+!5 = distinct !DISubprogram(name: "debug", scope: !1, file: !1, line: 1, type: !6, scopeLine: 1, spFlags: DISPFlagDefinition, unit: !0, retainedNodes: !2)
+!6 = !DISubroutineType(types: !7)
+!7 = !{!8, !8, !9}
+!8 = !DIBasicType(name: "int", size: 32, encoding: DW_ATE_signed)
+!9 = !DIBasicType(name: "long", size: 64, encoding: DW_ATE_signed)
+!10 = !DILocalVariable(name: "pr", scope: !5, file: !1, line: 2, type: !11)
+!11 = distinct !DICompositeType(tag: DW_TAG_structure_type, name: "pair", file: !1, line: 2, size: 64, elements: !12)
+!12 = !{!13, !14}
+!13 = !DIDerivedType(tag: DW_TAG_member, name: "a", scope: !11, file: !1, line: 2, baseType: !8, size: 32)
+!14 = !DIDerivedType(tag: DW_TAG_member, name: "b", scope: !11, file: !1, line: 2, baseType: !8, size: 32, offset: 32)
+!15 = !DILocation(line: 3, column: 1, scope: !5)
+!16 = !DILocalVariable(name: "box", scope: !5, file: !1, line: 2, type: !17)
+!17 = distinct !DICompositeType(tag: DW_TAG_structure_type, name: "box", file: !1, line: 2, size: 64, elements: !18)
+!18 = !{!19}
+!19 = !DIDerivedType(tag: DW_TAG_member, name: "v", scope: !17, file: !1, line: 2, baseType: !9, size: 64)
@@ -55,6 +55,13 @@ bodyptr ubody_alloc(int p);
 bodyptr movebodies(bodyptr list, int proc);
 void freetree(nodeptr n);
 void freetree1(nodeptr n);
+#ifdef THREADED
+cellptr arena_cell();
+void arena_reset();
+nodeptr maketree_parallel(treeptr t, int nstep);
+void computegrav_parallel(treeptr t, int nstep);
+void vp_parallel(treeptr t, int nstep);
+#endif
 
 int arg1;
 int __NumNodes = 1;
@@ -306,12 +313,20 @@ void stepsystem(treeptr t, int nstep)
   /*chatting("Entered stepsystem with t = 0x%x\n",t);*/
   root = Root(t);
   if (root != (nodeptr)NULL) {
+#ifdef THREADED
+    arena_reset();
+#else
     freetree1(root);
+#endif
     Root(t) = (nodeptr)NULL;
   }
 
   /*chatting("Tree freed\n");*/
+#ifdef THREADED
+  root = maketree_parallel(t, nstep);
+#else
   root = maketree(bt, nbody, t, nstep, 0);
+#endif
 #ifdef VERIFY_AFFINITIES
   chatting("checking tree 0x%x\n",root);
   Docheck_tree((cellptr) root);
@@ -321,10 +336,15 @@ void stepsystem(treeptr t, int nstep)
   Root(t)=root;
 /*   chatting("EventCount after = %d\n",EventCount); */
 
+#ifdef THREADED
+  computegrav_parallel(t, nstep);
+  vp_parallel(t, nstep);
+#else
   computegrav(t, nstep);
   /*chatting("Done cg\n");*/
 
   vp(t->bodiesperproc[0],nstep);
+#endif
 
 /*   chatting("CG Cmisses = %d\n",cflctdiff); */
   return 0;
@@ -429,12 +449,16 @@ cellptr cell_alloc(int p)
 { register cellptr tmp;
   register int i;
 
+#ifdef THREADED
+  tmp = arena_cell();
+#else
   if (cp_free_list != NULL) {
     tmp = (cellptr) cp_free_list;
     cp_free_list = (nodeptr) FL_Next((cellptr) cp_free_list);
   }
   else 
     tmp = (cellptr) ALLOC(p,sizeof(cell));
+#endif
   Type(tmp) = CELL;
   Proc(tmp) = p;
   for (i=0; i < NSUB; i++)
@@ -0,0 +1,342 @@
+/* parallel.c - threaded tree build and force computation for bh
+ *
+ * Every step runs three parallel phases, each a list of tasks handed out
+ * by the work-stealing scheduler in olden_threads.c, as in em3d.
+ *
+ *   tree build  The bodies are sorted into buckets by the cell they fall
+ *               in SPLIT_LEVELS levels below the root (512 buckets). Each
+ *               task loads one bucket's bodies into a subtree of its own
+ *               with the unchanged loadtree() and runs hackcofm() on it.
+ *               The main thread then joins the subtrees under the top
+ *               cells and finds their centres of mass.
+ *   forces      hackgrav() for each chunk of bodies. A body's walk only
+ *               writes its own Phi and New_Acc.
+ *   update      vp() over each chunk of the body list.
+ *
+ * The box is grown over all bodies, in the serial order, before the build,
+ * so the tree comes out the same as the one maketree() inserts body by
+ * body: in both, a cell exists exactly where two or more bodies share a
+ * box. The one exception is a box that grows more than once while it
+ * holds a single body, which leaves maketree() a chain of single-child
+ * cells; such a step is built serially. All sums run in the same order as
+ * the serial code, so positions and velocities are the same bit for bit.
+ *
+ * Cells come from per-thread arenas (arena_cell()). The tree is rebuilt
+ * every step, so freeing it is just rewinding the arenas.
+ *
+ * The number of threads is OLDEN_THREADS from the environment, or the
+ * number of online processors.
+ */
+
+#include <stdlib.h>
+#include "olden_threads.h"
+#define global extern
+#include "defs.h"
+#include "code.h"
+
+/* stdinc.h makes void int, so "void" functions end in return 0, as in
+ * newbh.c. The phase tasks are the exception: olden_phase() calls them
+ * through a real void pointer, so they are defined without the macro.
+ */
+
+#define CHUNK 64
+#define ARENA_BLOCK 1024
+#define SPLIT_LEVELS 3
+#define NBUCKETS (1 << (NDIM * SPLIT_LEVELS))
+
+nodeptr loadtree(bodyptr p, icstruct xpic, nodeptr t, int l, treeptr tr);
+icstruct intcoord(bodyptr p, treeptr t);
+int ic_test(bodyptr p, treeptr t);
+int old_subindex(icstruct ic, int l);
+real hackcofm(nodeptr q);
+nodeptr maketree(bodyptr btab, int nb, treeptr t, int nsteps, int proc);
+void gravstep(real rsize, nodeptr rt, bodyptr p, int nstep, real dthf);
+void vp(bodyptr q, int nstep);
+
+typedef struct block_t {
+  struct block_t *next;
+  cell cells[ARENA_BLOCK];
+} block_t;
+
+/* A thread's cell arena: blocks are kept across steps. */
+typedef struct arena_t {
+  block_t *first;
+  block_t *cur;
+  long used;		/* cells handed out from cur */
+  char pad[64];		/* keep threads' arenas on separate lines */
+} arena_t;
+
+static arena_t arenas[OLDEN_MAXTHREADS];	/* by olden_self() */
+
+/* The bodies in list order; the list does not change after old_main(). */
+static bodyptr *bodies;
+static long nbodies;
+static bodyptr *links;	/* what each chunk's last body pointed to */
+
+/* Tree build state. */
+static treeptr cur_tree;
+static icstruct *coords;	/* integer coordinates of bodies[i] */
+static int *bucket_of;		/* its bucket, or -1 if it is massless */
+static long *order;		/* body indices sorted by bucket */
+static long bucket_start[NBUCKETS + 1];
+static nodeptr bucket_root[NBUCKETS];
+
+/* Force computation state. */
+static nodeptr cur_root;
+static real cur_rsize;
+static int cur_step;
+
+cellptr arena_cell()
+{
+  arena_t *w = &arenas[olden_self()];
+
+  if (w->cur == NULL || w->used == ARENA_BLOCK) {
+    if (w->cur && w->cur->next)
+      w->cur = w->cur->next;
+    else {
+      block_t *b = (block_t *) malloc(sizeof(block_t));
+
+      if (b == NULL) {
+	chatting("arena_cell: out of memory\n");
+	exit(1);
+      }
+      b->next = NULL;
+      if (w->cur)
+	w->cur->next = b;
+      else
+	w->first = b;
+      w->cur = b;
+    }
+    w->used = 0;
+  }
+  return &w->cur->cells[w->used++];
+}
+
+void arena_reset()
+{
+  int t;
+
+  for (t = 0; t < OLDEN_MAXTHREADS; t++) {
+    arenas[t].cur = arenas[t].first;
+    arenas[t].used = 0;
+  }
+  return 0;
+}
+
+static void init_bodies(treeptr t)
+{
+  bodyptr q;
+  long i;
+
+  /* __NumNodes is 1: every body is on bodiesperproc[0] */
+  for (q = t->bodiesperproc[0]; q != NULL; q = Proc_Next(q))
+    nbodies++;
+  bodies = (bodyptr *) malloc(nbodies * sizeof(bodyptr));
+  links = (bodyptr *) malloc((nbodies / CHUNK + 1) * sizeof(bodyptr));
+  coords = (icstruct *) malloc(nbodies * sizeof(icstruct));
+  bucket_of = (int *) malloc(nbodies * sizeof(int));
+  order = (long *) malloc(nbodies * sizeof(long));
+  if (!bodies || !links || !coords || !bucket_of || !order) {
+    chatting("init_bodies: out of memory\n");
+    exit(1);
+  }
+  for (i = 0, q = t->bodiesperproc[0]; q != NULL; q = Proc_Next(q))
+    bodies[i++] = q;
+  return 0;
+}
+
+static long nchunks()
+{
+  return (nbodies + CHUNK - 1) / CHUNK;
+}
+
+#undef void
+static void bucket_task(long c)
+{
+  long i, end = (c + 1) * CHUNK < nbodies ? (c + 1) * CHUNK : nbodies;
+  int d, b;
+
+  for (i = c * CHUNK; i < end; i++) {
+    if (Mass(bodies[i]) == 0.0) {
+      bucket_of[i] = -1;
+      continue;
+    }
+    coords[i] = intcoord(bodies[i], cur_tree);
+    for (b = 0, d = 1; d <= SPLIT_LEVELS; d++)
+      b = b * NSUB + old_subindex(coords[i], IMAX >> d);
+    bucket_of[i] = b;
+  }
+}
+
+static void subtree_task(long b)
+{
+  nodeptr rt = NULL;
+  long i;
+
+  for (i = bucket_start[b]; i < bucket_start[b + 1]; i++)
+    rt = loadtree(bodies[order[i]], coords[order[i]], rt,
+		  IMAX >> (SPLIT_LEVELS + 1), cur_tree);
+  if (rt != NULL && Type(rt) == CELL)
+    hackcofm(rt);
+  bucket_root[b] = rt;
+}
+#define void int
+
+/* The top SPLIT_LEVELS levels of the tree, over the bucket subtrees. The
+ * centre of mass is summed as in hackcofm(), from the children's.
+ */
+static nodeptr join_subtrees(int depth, int b, long *count)
+{
+  nodeptr kids[NSUB], only = NULL, r;
+  vector tmpv, tmp_pos;
+  cellptr c;
+  real mq;
+  long n = 0, k;
+  int i;
+
+  if (depth == SPLIT_LEVELS) {
+    *count = bucket_start[b + 1] - bucket_start[b];
+    return bucket_root[b];
+  }
+  for (i = 0; i < NSUB; i++) {
+    kids[i] = join_subtrees(depth + 1, b * NSUB + i, &k);
+    if (k)
+      only = kids[i];
+    n += k;
+  }
+  *count = n;
+  if (n < 2)
+    return only;
+
+  c = arena_cell();
+  Type(c) = CELL;
+  Proc(c) = 0;
+  mq = 0.0;
+  CLRV(tmp_pos);
+  for (i = 0; i < NSUB; i++) {
+    Subp(c)[i] = r = kids[i];
+    if (r != NULL) {
+      mq = Mass(r) + mq;
+      MULVS(tmpv, Pos(r), Mass(r));
+      ADDV(tmp_pos, tmp_pos, tmpv);
+    }
+  }
+  Mass(c) = mq;
+  SETV(Pos(c), tmp_pos);
+  DIVVS(Pos(c), Pos(c), Mass(c));
+  return (nodeptr) c;
+}
+
+/* expandbox() without the repotting: there is no tree yet. */
+static void growbox(bodyptr p, treeptr t)
+{
+  vector rmid;
+  real rsize;
+  int k;
+
+  while (!ic_test(p, t)) {
+    rsize = Rsize(t);
+    assert(rsize<1000.0,999);
+    ADDVS(rmid, Rmin(t), 0.5 * rsize);
+    for (k = 0; k < NDIM; k++)
+      if (Pos(p)[k] < rmid[k])
+	Rmin(t)[k] = Rmin(t)[k] - rsize;
+    Rsize(t) = 2.0 * rsize;
+  }
+  return 0;
+}
+
+nodeptr maketree_parallel(treeptr t, int nstep)
+{
+  vector rmin0;
+  real rsize0, rsize;
+  long i, n, seen = 0;
+  int b;
+
+  if (bodies == NULL)
+    init_bodies(t);
+  Root(t) = NULL;
+
+  SETV(rmin0, Rmin(t));
+  rsize0 = Rsize(t);
+  for (i = 0; i < nbodies; i++)
+    if (Mass(bodies[i]) != 0.0) {
+      rsize = Rsize(t);
+      growbox(bodies[i], t);
+      if (seen++ == 1 && Rsize(t) > 2.0 * rsize) {
+	/* maketree() would repot the lone first body more than once */
+	SETV(Rmin(t), rmin0);
+	Rsize(t) = rsize0;
+	return maketree(NULL, nbody, t, nstep, 0);
+      }
+    }
+
+  cur_tree = t;
+  olden_phase(bucket_task, nchunks());
+
+  /* stable counting sort, so each bucket loads in list order */
+  for (b = 0; b <= NBUCKETS; b++)
+    bucket_start[b] = 0;
+  for (i = 0; i < nbodies; i++)
+    if (bucket_of[i] >= 0)
+      bucket_start[bucket_of[i] + 1]++;
+  for (b = 0; b < NBUCKETS; b++)
+    bucket_start[b + 1] += bucket_start[b];
+  for (i = 0; i < nbodies; i++)
+    if (bucket_of[i] >= 0)
+      order[bucket_start[bucket_of[i]]++] = i;
+  for (b = NBUCKETS; b > 0; b--)
+    bucket_start[b] = bucket_start[b - 1];
+  bucket_start[0] = 0;
+
+  olden_phase(subtree_task, NBUCKETS);
+  Root(t) = join_subtrees(0, 0, &n);
+  return Root(t);
+}
+
+#undef void
+static void grav_task(long c)
+{
+  long i, end = (c + 1) * CHUNK < nbodies ? (c + 1) * CHUNK : nbodies;
+
+  for (i = c * CHUNK; i < end; i++)
+    gravstep(cur_rsize, cur_root, bodies[i], cur_step, 0.5 * dtime);
+}
+#define void int
+
+void computegrav_parallel(treeptr t, int nstep)
+{
+  cur_root = Root(t);
+  cur_rsize = Rsize(t);
+  cur_step = nstep;
+  olden_phase(grav_task, nchunks());
+  return 0;
+}
+
+#undef void
+static void vp_task(long c)
+{
+  vp(bodies[c * CHUNK], cur_step);
+}
+#define void int
+
+/* vp() walks a list, so the list is cut after every CHUNK bodies while the
+ * chunks run, and joined again afterwards.
+ */
+void vp_parallel(treeptr t, int nstep)
+{
+  long c, last;
+
+  for (c = 0; c < nchunks(); c++) {
+    last = (c + 1) * CHUNK < nbodies ? (c + 1) * CHUNK - 1 : nbodies - 1;
+    links[c] = Proc_Next(bodies[last]);
+    Proc_Next(bodies[last]) = NULL;
+  }
+  cur_step = nstep;
+  olden_phase(vp_task, nchunks());
+  for (c = 0; c < nchunks(); c++) {
+    last = (c + 1) * CHUNK < nbodies ? (c + 1) * CHUNK - 1 : nbodies - 1;
+    Proc_Next(bodies[last]) = links[c];
+  }
+  return 0;
+}
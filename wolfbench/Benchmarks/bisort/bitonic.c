@@ -6,6 +6,11 @@
 #define CONST_m1 10000
 #define CONST_b 31415821
 #define RANGE 100
+/* The adaptive merge needs distinct keys: with equal ones it can take the
+ * wrong path down the tree and leave values out of place. Each value is
+ * one of RANGE buckets, made unique by RandTree()'s call number (there are
+ * about 2n calls) in the low UNIQUE_BITS bits. */
+#define UNIQUE_BITS 23
 #define NULL 0
 
 #include <stdio.h>
@@ -71,10 +76,47 @@ if ((h != NIL))
    l = h->left;
    r = h->right;
    InOrder(l);
-   chatting("%d @ 0x%x\n",val,(unsigned int)h);
+   chatting("%d @ %p\n",val,(void *)h);
    InOrder(r);
   }
 }
+/* Walks the tree in order, as InOrder() prints it, counting the values
+ * that are out of order for dir and summing them all. */
+static int prev_val, misplaced, seen;
+static long checksum;
+
+static void
+CheckWalk(h,dir)
+HANDLE *h;
+int dir;
+{
+  if (h != NIL)
+    {
+      CheckWalk(h->left,dir);
+      if (seen++ && ((prev_val > h->value) ^ dir))
+        misplaced++;
+      prev_val = h->value;
+      checksum += h->value;
+      CheckWalk(h->right,dir);
+    }
+}
+
+void
+CheckSorted(h,sval,dir)
+HANDLE *h;
+int sval,dir;
+{
+  misplaced = 0;
+  seen = 0;
+  checksum = 0;
+  CheckWalk(h,dir);
+  if (seen && ((prev_val > sval) ^ dir))
+    misplaced++;
+  checksum += sval;
+  chatting("%s: %d out of order, checksum %ld\n",
+	   dir ? "Descending" : "Ascending", misplaced, checksum);
+}
+
 int mult(int p, int q)
 {
 	int p1, p0, q1, q0;
@@ -104,7 +146,6 @@ HANDLE* RandTree(n,seed,node,level)
 
 {
   int next_val,my_name;
-  future_cell_int f_left, f_right;
   HANDLE *h;
   my_name=foo++;
   if ((n > 1))
@@ -117,12 +158,10 @@ HANDLE* RandTree(n,seed,node,level)
       else
 	newnode = node;
       seed = myrandom(seed);
-      next_val=seed % RANGE;
+      next_val=(seed % RANGE << UNIQUE_BITS) + my_name;
       NewNode(h,next_val,node);
-      f_left.value=(int) RandTree((n/2),seed,newnode,level+1);
-      f_right.value=(int) RandTree((n/2),skiprand(seed,(n)+1),node,level+1);
-      h->left = (HANDLE *) f_left.value;
-      h->right = (HANDLE *) f_right.value;
+      h->left = RandTree((n/2),seed,newnode,level+1);
+      h->right = RandTree((n/2),skiprand(seed,(n)+1),node,level+1);
     }
   else 
     h = NIL;
@@ -254,10 +293,13 @@ int lval, rval;
   /*chatting("Swap Val Right l 0x%x,r 0x%x val: %d %d\n",l,r,lval,rval);*/
 } 
 
+/* The exchange walk of Bimerge(): after it, every value in root's left
+ * subtree is on the dir side of every value in its right subtree and the
+ * spare, so the two halves can be merged independently. */
 int
-/********************/
-Bimerge(root,spr_val,dir)
-/********************/
+/************************/
+BimergeSwap(root,spr_val,dir)
+/************************/
 HANDLE *root;
 int spr_val,dir;
 
@@ -266,11 +308,6 @@ int spr_val,dir;
   int temp;
   HANDLE *pl,*pll,*plr;
   HANDLE *pr,*prl,*prr;
-  HANDLE *rl;
-  HANDLE *rr;
-#ifdef  DUMB
-  HANDLE *dummy;
-#endif  
   int rv,lv;
 
 
@@ -324,6 +361,23 @@ int spr_val,dir;
             pr = prl;
           }
     }
+  return spr_val;
+} 
+
+int
+/********************/
+Bimerge(root,spr_val,dir)
+/********************/
+HANDLE *root;
+int spr_val,dir;
+
+{ HANDLE *rl;
+  HANDLE *rr;
+#ifdef  DUMB
+  HANDLE *dummy;
+#endif  
+
+  spr_val = BimergeSwap(root,spr_val,dir);
   if ((root->left != NIL))
     { 
       future_cell_int f_left;
@@ -407,11 +461,15 @@ char *argv[];
    
   
   n = dealwithargs(argc,argv);
+  if (n > 1 << (UNIQUE_BITS - 1)) {
+    chatting("Size %d is too large, at most %d\n", n, 1 << (UNIQUE_BITS - 1));
+    exit(1);
+  }
 
   chatting("Bisort with %d size on %d procs of dim %d\n",
 	   n, __NumNodes, __NDim);
   h = RandTree(n,12345768,0,0);
-  sval = myrandom(245867) % RANGE;
+  sval = (myrandom(245867) % RANGE << UNIQUE_BITS) + foo;
   if (flag) {
     InOrder(h);
     chatting("%d\n",sval);
@@ -425,14 +483,24 @@ char *argv[];
 #endif
 
 
+#ifdef THREADED
+  sval=ParallelBisort(h,sval,0);
+#else
   sval=Bisort(h,sval,0);
+#endif
+  CheckSorted(h,sval,0);
   if (flag) {
     chatting("Sorted Tree:\n"); 
     InOrder(h);
     chatting("%d\n",sval);
    }
   
+#ifdef THREADED
+  sval=ParallelBisort(h,sval,1);
+#else
   sval=Bisort(h,sval,1);
+#endif
+  CheckSorted(h,sval,1);
   if (flag) {
     chatting("Sorted Tree:\n"); 
     InOrder(h);
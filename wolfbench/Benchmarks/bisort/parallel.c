@@ -0,0 +1,92 @@
+/* parallel.c - fork-join Bisort and Bimerge
+ *
+ * Bisort() sorts the two subtrees of a node, in opposite directions, and
+ * Bimerge() merges them; after its exchange walk, Bimerge() merges the
+ * two subtrees independently too. Neither recursion touches anything
+ * outside the subtree it is given, so at every level the left half is
+ * forked onto the pool (olden_threads.c) while the right half runs in
+ * place. Below SERIAL_HEIGHT levels the serial routines take over, which
+ * leaves tasks of a few thousand nodes. Every node ends up with the value
+ * the serial sort gives it.
+ */
+
+#include <stdlib.h>
+#include "node.h"
+#include "proc.h"
+#include "olden_threads.h"
+
+#define SERIAL_HEIGHT 12
+
+typedef struct job_t {
+  HANDLE *root;
+  int value, dir, height;
+  task_t task;
+} job_t;
+
+static int ParBimerge(HANDLE *root, int spr_val, int dir, int height);
+static int ParBisort(HANDLE *root, int spr_val, int dir, int height);
+
+static void bimerge_job(void *arg)
+{
+  job_t *j = (job_t *) arg;
+
+  j->value = ParBimerge(j->root, j->value, j->dir, j->height);
+}
+
+static void bisort_job(void *arg)
+{
+  job_t *j = (job_t *) arg;
+
+  j->value = ParBisort(j->root, j->value, j->dir, j->height);
+}
+
+static int ParBimerge(HANDLE *root, int spr_val, int dir, int height)
+{
+  job_t left;
+
+  if (height <= SERIAL_HEIGHT)
+    return Bimerge(root, spr_val, dir);
+  spr_val = BimergeSwap(root, spr_val, dir);
+  if (root->left != NIL) {
+    left.root = root->left;
+    left.value = root->value;
+    left.dir = dir;
+    left.height = height - 1;
+    pool_fork(&left.task, bimerge_job, &left);
+    spr_val = ParBimerge(root->right, spr_val, dir, height - 1);
+    pool_join(&left.task);
+    root->value = left.value;
+  }
+  return spr_val;
+}
+
+static int ParBisort(HANDLE *root, int spr_val, int dir, int height)
+{
+  job_t left;
+
+  if (height <= SERIAL_HEIGHT || root->left == NIL)
+    return Bisort(root, spr_val, dir);
+  left.root = root->left;
+  left.value = root->value;
+  left.dir = dir;
+  left.height = height - 1;
+  pool_fork(&left.task, bisort_job, &left);
+  spr_val = ParBisort(root->right, spr_val, !dir, height - 1);
+  pool_join(&left.task);
+  root->value = left.value;
+  return ParBimerge(root, spr_val, dir, height);
+}
+
+/* RandTree() builds a complete tree, so its height is that of the left
+ * spine.
+ */
+int ParallelBisort(HANDLE *root, int spr_val, int dir)
+{
+  HANDLE *h;
+  int height = 0;
+
+  for (h = root; h != NIL; h = h->left)
+    height++;
+  pool_init();
+  return ParBisort(root, spr_val, dir, height);
+}
@@ -6,8 +6,10 @@ HANDLE *RandTree();
 void SwapValue();
 void SwapValLeft();
 void SwapValRight();
+int BimergeSwap();
 int Bimerge();
 int Bisort();
+int ParallelBisort();
 #define DD_EXIT 0
 
 
@@ -34,8 +34,9 @@ typedef unsigned char bool_t;
 #include        <sys/socket.h>
 #include        <sys/un.h>
 #include        <sys/resource.h>
-#define PORTMAP
-#include	<rpc/rpc.h>
+/* <rpc/rpc.h> used to be included here for the portmapper. glibc no longer
+ * ships Sun RPC and NO_PORTMAPPER is always defined below, so it is gone.
+ */
 #endif
 
 #ifdef HAVE_uint64_t
@@ -134,8 +135,10 @@ int	gettimeofday(struct timeval *tv, struct timezone *tz);
 
 #define	TRIES		11
 
+/* a ring of the last TRIES results, oldest at head; see insertsort() */
 typedef struct {
 	int	N;
+	int	head;
 	uint64	u[TRIES];
 	uint64	n[TRIES];
 } result_t;
@@ -236,7 +239,6 @@ void	get_results(result_t *r);
  * It was generated using rpcgen.
  */
 
-#include <rpc/types.h>
 
 #define XACT_PROG ((u_long)404040)
 #define XACT_VERS ((u_long)1)
@@ -16,6 +16,16 @@ char	*id = "$Id: bwmem.c,v 1.1 2004/04/15 20:18:41 renau Exp $";
 
 #include "bench.h"
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#ifdef HAVE_NUMA
+#define	inline	__inline__	/* numa.h is C99, we are built as C89 */
+#include <numa.h>
+#undef	inline
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define TYPE    int
 
@@ -27,9 +37,15 @@ char	*id = "$Id: bwmem.c,v 1.1 2004/04/15 20:18:41 renau Exp $";
  * fwr - write every 4 byte word
  * frd - read every 4 byte word
  * fcp - copy every 4 byte word
+ * ntwr - write every 4 byte word with non-temporal (cache bypassing) stores
+ * ntcp - copy every 4 byte word with non-temporal stores to the destination
  *
  * All tests do 512 byte chunks in a loop.
  *
+ * With -P threads, each kernel runs on that many threads at once, each
+ * pinned to its own CPU and working on its own size-byte buffer allocated
+ * on that CPU's NUMA node, and per-thread and aggregate GB/s are reported.
+ *
  * XXX - do a 64bit version of this.
  */
 void	rd(TYPE *buf, TYPE *lastone);
@@ -39,32 +55,46 @@ void	cp(TYPE *buf, TYPE *dst, TYPE *lastone);
 void	fwr(TYPE *buf, TYPE *lastone);
 void	frd(TYPE *buf, TYPE *lastone);
 void	fcp(TYPE *buf, TYPE *dst, TYPE *lastone);
+void	ntwr(TYPE *buf, TYPE *lastone);
+void	ntcp(TYPE *buf, TYPE *dst, TYPE *lastone);
+int	parallel(char *what, int nbytes, int nthreads, int conflict);
 
 int
 main(ac, av)
         char  **av;
 {
-	int	nbytes;
+	int	nbytes, nthreads = 0;
 	TYPE   *buf = 0, *buf2 = 0, *lastone;
 
+	if (ac > 2 && streq(av[1], "-P")) {
+		nthreads = atoi(av[2]);
+		if (nthreads < 1) goto usage;
+		av[2] = av[0];
+		av += 2;
+		ac -= 2;
+	}
 	if (ac < 3) {
-usage:		fprintf(stderr, "Usage: %s size what [conflict]\n", av[0]);
+usage:		fprintf(stderr, "Usage: %s [-P threads] size what [conflict]\n", av[0]);
 		fprintf(stderr, 
-		    "what: rd wr rdwr cp fwr frd fcp bzero bcopy\n");
+		    "what: rd wr rdwr cp fwr frd fcp ntwr ntcp bzero bcopy\n");
 		exit(1);
 	}
 	nbytes = bytes(av[1]);
 	if (nbytes < 512) {	/* this is the number of bytes in the loop */
 		exit(1);
 	}
+	if (nthreads) {
+		if (parallel(av[2], nbytes, nthreads, ac > 3) < 0) goto usage;
+		return(0);
+	}
         buf = (TYPE *)malloc(nbytes);
 	lastone = (TYPE*)((char *)buf + nbytes - 512);
 	if (!buf) {
 		perror("malloc");
 		exit(1);
 	}
-	if (streq(av[2], "cp") ||
-	    streq(av[2], "fcp") || streq(av[2], "bcopy")) {
+	if (streq(av[2], "cp") || streq(av[2], "fcp") ||
+	    streq(av[2], "ntcp") || streq(av[2], "bcopy")) {
         	buf2 = (TYPE *)malloc(nbytes + 2048);
 		if (!buf2) {
 			perror("malloc");
@@ -95,6 +125,10 @@ usage:		fprintf(stderr, "Usage: %s size what [conflict]\n", av[0]);
 		BENCHO(fwr(buf, lastone), fwr(buf, 0), 0);
 	} else if (streq(av[2], "fcp")) {
 		BENCHO(fcp(buf, buf2, lastone), fcp(buf, buf2, 0), 0);
+	} else if (streq(av[2], "ntwr")) {
+		BENCHO(ntwr(buf, lastone), ntwr(buf, 0), 0);
+	} else if (streq(av[2], "ntcp")) {
+		BENCHO(ntcp(buf, buf2, lastone), ntcp(buf, buf2, 0), 0);
 	} else if (streq(av[2], "bzero")) {
 		BENCHO(bzero((void*)buf, nbytes), bzero((void*)buf, 1), 0);
 	} else if (streq(av[2], "bcopy")) {
@@ -282,3 +316,250 @@ fcp(register TYPE *p, register TYPE *dst, register TYPE *lastone)
 	}
 	use_pointer((void*)p);
 }
+#undef	DOIT
+
+/*
+ * Non-temporal variants: the stores go around the caches straight to
+ * memory, so a write does not first have to read the line in. Without
+ * SSE2 they fall back to ordinary stores.
+ */
+void
+ntwr(register TYPE *p, register TYPE *lastone)
+{
+#ifdef __SSE2__
+	register __m128i one = _mm_set1_epi32(1);
+
+	while (p <= lastone) {
+		register __m128i *q = (__m128i *)p;
+#define	DOIT(i)	_mm_stream_si128(q + i, one);
+		DOIT(0) DOIT(1) DOIT(2) DOIT(3) DOIT(4) DOIT(5) DOIT(6)
+		DOIT(7) DOIT(8) DOIT(9) DOIT(10) DOIT(11) DOIT(12)
+		DOIT(13) DOIT(14) DOIT(15) DOIT(16) DOIT(17) DOIT(18)
+		DOIT(19) DOIT(20) DOIT(21) DOIT(22) DOIT(23) DOIT(24)
+		DOIT(25) DOIT(26) DOIT(27) DOIT(28) DOIT(29) DOIT(30)
+		DOIT(31)
+		p += 128;
+	}
+	_mm_sfence();
+#undef	DOIT
+#else
+	fwr(p, lastone);
+#endif
+	use_pointer((void*)p);
+}
+
+void
+ntcp(register TYPE *p, register TYPE *dst, register TYPE *lastone)
+{
+#ifdef __SSE2__
+	while (p <= lastone) {
+		register __m128i *s = (__m128i *)p, *d = (__m128i *)dst;
+#define	DOIT(i)	_mm_stream_si128(d + i, _mm_loadu_si128(s + i));
+		DOIT(0) DOIT(1) DOIT(2) DOIT(3) DOIT(4) DOIT(5) DOIT(6)
+		DOIT(7) DOIT(8) DOIT(9) DOIT(10) DOIT(11) DOIT(12)
+		DOIT(13) DOIT(14) DOIT(15) DOIT(16) DOIT(17) DOIT(18)
+		DOIT(19) DOIT(20) DOIT(21) DOIT(22) DOIT(23) DOIT(24)
+		DOIT(25) DOIT(26) DOIT(27) DOIT(28) DOIT(29) DOIT(30)
+		DOIT(31)
+		p += 128;
+		dst += 128;
+	}
+	_mm_sfence();
+#undef	DOIT
+#else
+	fcp(p, dst, lastone);
+#endif
+	use_pointer((void*)p);
+}
+
+/*
+ * Multi-threaded driver.
+ *
+ * Every worker pins itself first and only then allocates and touches its
+ * buffers, so the pages land on the worker's own NUMA node (explicitly
+ * with libnuma when built with -DHAVE_NUMA, by first touch otherwise).
+ * A round starts all workers at a barrier; each runs its kernel over its
+ * buffer until PAR_SECS have passed and counts the passes. Per-thread
+ * bandwidth uses the worker's own time, aggregate bandwidth the wall time
+ * of the whole round. The best of PAR_ROUNDS rounds is reported.
+ */
+#define	PAR_SECS	0.2
+#define	PAR_ROUNDS	5
+#define	GB		(1000.0*1000.0*1000.0)
+
+typedef struct {
+	int	id;
+	int	cpu;
+	int	node;
+	TYPE	*buf, *buf2, *lastone;
+	uint64	passes;		/* best round */
+	double	secs;
+	uint64	last_passes;	/* latest round, read by the main thread */
+	double	last_secs;
+} worker_t;
+
+static char		*par_what;
+static int		par_nbytes;
+static int		par_conflict;
+static pthread_barrier_t par_go, par_done;
+
+static double
+secs_now(void)
+{
+	return (now_ns() / 1e9);
+}
+
+static char *kernels[] = {
+	"rd", "wr", "rdwr", "cp", "frd", "fwr", "fcp", "ntwr", "ntcp",
+	"bzero", "bcopy", 0
+};
+
+static void
+kernel(char *what, TYPE *buf, TYPE *buf2, TYPE *lastone)
+{
+	if (streq(what, "rd")) rd(buf, lastone);
+	else if (streq(what, "wr")) wr(buf, lastone);
+	else if (streq(what, "rdwr")) rdwr(buf, lastone);
+	else if (streq(what, "cp")) cp(buf, buf2, lastone);
+	else if (streq(what, "frd")) frd(buf, lastone);
+	else if (streq(what, "fwr")) fwr(buf, lastone);
+	else if (streq(what, "fcp")) fcp(buf, buf2, lastone);
+	else if (streq(what, "ntwr")) ntwr(buf, lastone);
+	else if (streq(what, "ntcp")) ntcp(buf, buf2, lastone);
+	else if (streq(what, "bzero")) bzero((void*)buf, par_nbytes);
+	else if (streq(what, "bcopy")) bcopy((void*)buf, (void*)buf2, par_nbytes);
+}
+
+static void *
+par_alloc(int size)
+{
+	void	*p;
+
+#ifdef HAVE_NUMA
+	if (numa_available() >= 0) {
+		p = numa_alloc_local(size);
+	} else
+#endif
+	p = malloc(size);
+	if (!p) {
+		perror("malloc");
+		exit(1);
+	}
+	bzero(p, size);		/* first touch, on this thread's node */
+	return (p);
+}
+
+static void *
+worker(void *arg)
+{
+	worker_t *w = (worker_t *)arg;
+	cpu_set_t set;
+	int	round;
+
+	CPU_ZERO(&set);
+	CPU_SET(w->cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#ifdef HAVE_NUMA
+	w->node = numa_available() >= 0 ? numa_node_of_cpu(w->cpu) : -1;
+#else
+	w->node = -1;
+#endif
+
+	w->buf = (TYPE *)par_alloc(par_nbytes);
+	w->lastone = (TYPE *)((char *)w->buf + par_nbytes - 512);
+	if (w->buf2 == (TYPE *)1) {
+		w->buf2 = (TYPE *)par_alloc(par_nbytes + 2048);
+		/* same misalignment as the single-threaded cp */
+		if (!par_conflict) w->buf2 = (TYPE *)((char *)w->buf2 + 2048 - 128);
+	}
+	kernel(par_what, w->buf, w->buf2, w->lastone);	/* warm up */
+
+	for (round = 0; round < PAR_ROUNDS; round++) {
+		double	start, t;
+		uint64	passes = 0;
+
+		pthread_barrier_wait(&par_go);
+		start = secs_now();
+		do {
+			kernel(par_what, w->buf, w->buf2, w->lastone);
+			passes++;
+		} while ((t = secs_now()) - start < PAR_SECS);
+		w->last_passes = passes;
+		w->last_secs = t - start;
+		pthread_barrier_wait(&par_done);
+
+		if (round == 0 || passes / (t - start) > w->passes / w->secs) {
+			w->passes = passes;
+			w->secs = t - start;
+		}
+	}
+	return (0);
+}
+
+int
+parallel(char *what, int nbytes, int nthreads, int conflict)
+{
+	worker_t *w;
+	pthread_t *tid;
+	cpu_set_t allowed;
+	double	best = 0, start, wall;
+	int	i, cpu, round, ncpus;
+
+	for (i = 0; kernels[i] && !streq(kernels[i], what); i++)
+		;
+	if (!kernels[i]) return (-1);
+	par_what = what;
+	par_nbytes = nbytes;
+	par_conflict = conflict;
+
+	/* Spread the threads over the CPUs we are allowed to run on. */
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+	ncpus = CPU_COUNT(&allowed);
+	w = (worker_t *)calloc(nthreads, sizeof(worker_t));
+	tid = (pthread_t *)calloc(nthreads, sizeof(pthread_t));
+	for (i = 0, cpu = -1; i < nthreads; i++) {
+		do {
+			cpu = (cpu + 1) % CPU_SETSIZE;
+		} while (!CPU_ISSET(cpu, &allowed));
+		w[i].id = i;
+		w[i].cpu = cpu;
+		if (streq(what, "cp") || streq(what, "fcp") ||
+		    streq(what, "ntcp") || streq(what, "bcopy")) {
+			w[i].buf2 = (TYPE *)1;	/* allocate in the worker */
+		}
+	}
+
+	(void) now_ns();	/* settle the clock before the workers read it */
+	pthread_barrier_init(&par_go, 0, nthreads + 1);
+	pthread_barrier_init(&par_done, 0, nthreads + 1);
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&tid[i], 0, worker, &w[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (round = 0; round < PAR_ROUNDS; round++) {
+		uint64	passes = 0;
+
+		pthread_barrier_wait(&par_go);
+		start = secs_now();
+		pthread_barrier_wait(&par_done);
+		wall = secs_now() - start;
+		/* the barrier makes the workers' last_passes visible */
+		for (i = 0; i < nthreads; i++) passes += w[i].last_passes;
+		if (passes * (double)nbytes / wall > best) {
+			best = passes * (double)nbytes / wall;
+		}
+	}
+	for (i = 0; i < nthreads; i++) pthread_join(tid[i], 0);
+
+	fprintf(stderr, "%s: %d threads on %d cpus, %.2f MB each\n",
+	    what, nthreads, ncpus, nbytes / (1000.0 * 1000.0));
+	for (i = 0; i < nthreads; i++) {
+		fprintf(stderr, "thread %d cpu %d node %d: %.2f GB/s\n",
+		    w[i].id, w[i].cpu, w[i].node,
+		    w[i].passes * (double)nbytes / w[i].secs / GB);
+	}
+	fprintf(stderr, "aggregate: %.2f GB/s\n", best / GB);
+	return (0);
+}
@@ -20,7 +20,7 @@
 #define	MB	(1000*1000.0)
 #define	KB	(1000.0)
 
-static struct timeval start_tv, stop_tv;
+static	uint64	start_ns, stop_ns;	/* clock_ns() at start(0), stop(0, 0) */
 FILE		*ftiming;
 volatile uint64	use_result_dummy;	/* !static for optimizers. */
 static	uint64	iterations;
@@ -30,6 +30,92 @@ static	void	init_timing(void);
 #include <sys/mman.h>
 #endif
 
+/*
+ * The clock.  CLOCK_MONOTONIC_RAW is not slewed by NTP, so intervals are
+ * not stretched or shrunk while adjtime is correcting the wall clock.
+ * With TIMING_CLOCK=tsc in the environment an x86 time stamp counter is
+ * read instead, scaled by a rate calibrated against CLOCK_MONOTONIC_RAW;
+ * it is only meaningful on CPUs with an invariant TSC.
+ */
+#ifndef CLOCK_MONOTONIC_RAW
+#define	CLOCK_MONOTONIC_RAW	CLOCK_MONOTONIC
+#endif
+#define	CALIBRATE_NS	20000000	/* 20ms */
+
+static	int	clock_ready;
+static	double	tsc_ns;			/* ns per tick, 0 if not using the TSC */
+static	uint64	tsc_base;
+
+static uint64
+raw_ns(void)
+{
+	struct timespec ts;
+	uint64	ns;
+
+	(void) clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	ns = ts.tv_sec;
+	ns *= 1000000000;
+	ns += ts.tv_nsec;
+	return (ns);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static uint64
+rdtsc(void)
+{
+	unsigned int lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return (((uint64)hi << 32) | lo);
+}
+#endif
+
+static void
+init_clock(void)
+{
+	clock_ready = 1;
+#if defined(__x86_64__) || defined(__i386__)
+	if (getenv("TIMING_CLOCK") && streq(getenv("TIMING_CLOCK"), "tsc")) {
+		uint64	t0, t1, c0, c1;
+
+		t0 = raw_ns(); c0 = rdtsc();
+		while ((t1 = raw_ns()) - t0 < CALIBRATE_NS)
+			;
+		c1 = rdtsc();
+		if (c1 > c0) {
+			tsc_ns = (double)(t1 - t0) / (double)(c1 - c0);
+			tsc_base = c1;
+		}
+	}
+#endif
+}
+
+static uint64
+clock_ns(void)
+{
+	if (!clock_ready) init_clock();
+#if defined(__x86_64__) || defined(__i386__)
+	if (tsc_ns) return ((uint64)((rdtsc() - tsc_base) * tsc_ns));
+#endif
+	return (raw_ns());
+}
+
+static void
+ns2tv(uint64 ns, struct timeval *tv)
+{
+	tv->tv_sec = ns / 1000000000;
+	tv->tv_usec = (ns % 1000000000) / 1000;
+}
+
+/*
+ * Seconds between the last start(0) and stop(0, 0), or set by settime().
+ */
+static double
+elapsed(void)
+{
+	return (stop_ns > start_ns ? (stop_ns - start_ns) / 1e9 : 0.);
+}
+
 /*
  * Redirect output someplace else.
  */
@@ -40,15 +126,17 @@ timing(FILE *out)
 }
 
 /*
- * Start timing now.
+ * Start timing now.  A caller-supplied timeval gets the same clock,
+ * truncated to microseconds.
  */
 void
 start(struct timeval *tv)
 {
 	if (tv == NULL) {
-		tv = &start_tv;
+		start_ns = clock_ns();
+	} else {
+		ns2tv(clock_ns(), tv);
 	}
-	(void) gettimeofday(tv, (struct timezone *) 0);
 }
 
 /*
@@ -57,70 +145,63 @@ start(struct timeval *tv)
 uint64
 stop(struct timeval *begin, struct timeval *end)
 {
+	uint64	t = clock_ns();
+	struct timeval	tv;
+
 	if (end == NULL) {
-		end = &stop_tv;
+		stop_ns = t;
+	} else {
+		ns2tv(t, end);
 	}
-	(void) gettimeofday(end, (struct timezone *) 0);
-
 	if (begin == NULL) {
-		begin = &start_tv;
+		return (t > start_ns ? (t - start_ns + 500) / 1000 : 0);
+	}
+	if (end == NULL) {
+		ns2tv(t, &tv);
+		end = &tv;
 	}
 	return tvdelta(begin, end);
 }
 
+/*
+ * Nanoseconds on the timing clock; only differences mean anything.
+ */
 uint64
-now(void)
+now_ns(void)
 {
-	struct timeval t;
-	uint64	m;
+	return (clock_ns());
+}
 
-	(void) gettimeofday(&t, (struct timezone *) 0);
-	m = t.tv_sec;
-	m *= 1000000;
-	m += t.tv_usec;
-	return (m);
+uint64
+now(void)
+{
+	return (clock_ns() / 1000);
 }
 
 double
 Now(void)
 {
-	struct timeval t;
-
-	(void) gettimeofday(&t, (struct timezone *) 0);
-	return (t.tv_sec * 1000000.0 + t.tv_usec);
+	return (clock_ns() / 1000.0);
 }
 
 uint64
 delta(void)
 {
-	static struct timeval last;
-	struct timeval t;
-	struct timeval diff;
+	static uint64	last;
+	uint64	t = clock_ns();
 	uint64	m;
 
-	(void) gettimeofday(&t, (struct timezone *) 0);
-	if (last.tv_usec) {
-		tvsub(&diff, &t, &last);
-		last = t;
-		m = diff.tv_sec;
-		m *= 1000000;
-		m += diff.tv_usec;
-		return (m);
-	} else {
-		last = t;
-		return (0);
-	}
+	m = last ? (t - last) / 1000 : 0;
+	last = t;
+	return (m);
 }
 
 double
 Delta(void)
 {
-	struct timeval t;
-	struct timeval diff;
+	uint64	t = clock_ns();
 
-	(void) gettimeofday(&t, (struct timezone *) 0);
-	tvsub(&diff, &t, &start_tv);
-	return (diff.tv_sec + diff.tv_usec / 1000000.0);
+	return (t > start_ns ? (t - start_ns) / 1e9 : 0.);
 }
 
 void
@@ -141,23 +222,16 @@ get_n(void)
 void
 settime(uint64 usecs)
 {
-	bzero((void*)&start_tv, sizeof(start_tv));
-	stop_tv.tv_sec = usecs / 1000000;
-	stop_tv.tv_usec = usecs % 1000000;
+	start_ns = 0;
+	stop_ns = usecs * 1000;
 }
 
 void
 bandwidth(uint64 bytes, uint64 times, int verbose)
 {
-	struct timeval tdiff;
 	double  mb, secs;
 
-	tvsub(&tdiff, &stop_tv, &start_tv);
-	secs = tdiff.tv_sec;
-	secs *= 1000000;
-	secs += tdiff.tv_usec;
-	secs /= 1000000;
-	secs /= times;
+	secs = elapsed() / times;
 	mb = bytes / MB;
 	if (!ftiming) ftiming = stderr;
 	if (verbose) {
@@ -181,11 +255,9 @@ bandwidth(uint64 bytes, uint64 times, int verbose)
 void
 kb(uint64 bytes)
 {
-	struct timeval td;
 	double  s, bs;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	s = td.tv_sec + td.tv_usec / 1000000.0;
+	s = elapsed();
 	bs = bytes / nz(s);
 	if (!ftiming) ftiming = stderr;
 	(void) fprintf(ftiming, "%.0f KB/sec\n", bs / KB);
@@ -194,11 +266,9 @@ kb(uint64 bytes)
 void
 mb(uint64 bytes)
 {
-	struct timeval td;
 	double  s, bs;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	s = td.tv_sec + td.tv_usec / 1000000.0;
+	s = elapsed();
 	bs = bytes / nz(s);
 	if (!ftiming) ftiming = stderr;
 	(void) fprintf(ftiming, "%.2f MB/sec\n", bs / MB);
@@ -207,12 +277,10 @@ mb(uint64 bytes)
 void
 latency(uint64 xfers, uint64 size)
 {
-	struct timeval td;
 	double  s;
 
 	if (!ftiming) ftiming = stderr;
-	tvsub(&td, &stop_tv, &start_tv);
-	s = td.tv_sec + td.tv_usec / 1000000.0;
+	s = elapsed();
 	if (xfers > 1) {
 		fprintf(ftiming, "%d %dKB xfers in %.2f secs, ",
 		    (int) xfers, (int) (size / KB), s);
@@ -236,11 +304,9 @@ latency(uint64 xfers, uint64 size)
 void
 context(uint64 xfers)
 {
-	struct timeval td;
 	double  s;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	s = td.tv_sec + td.tv_usec / 1000000.0;
+	s = elapsed();
 	if (!ftiming) ftiming = stderr;
 	fprintf(ftiming,
 	    "%d context switches in %.2f secs, %.0f microsec/switch\n",
@@ -250,11 +316,9 @@ context(uint64 xfers)
 void
 nano(char *s, uint64 n)
 {
-	struct timeval td;
 	double  micro;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	micro = td.tv_sec * 1000000 + td.tv_usec;
+	micro = elapsed() * 1000000;
 	micro *= 1000;
 	if (!ftiming) ftiming = stderr;
 	fprintf(ftiming, "%s: %.0f nanoseconds\n", s, micro / n);
@@ -263,11 +327,9 @@ nano(char *s, uint64 n)
 void
 micro(char *s, uint64 n)
 {
-	struct timeval td;
 	double	micro;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	micro = td.tv_sec * 1000000 + td.tv_usec;
+	micro = elapsed() * 1000000;
 	micro /= n;
 	if (!ftiming) ftiming = stderr;
 	fprintf(ftiming, "%s: %.4f microseconds\n", s, micro);
@@ -285,11 +347,9 @@ micro(char *s, uint64 n)
 void
 micromb(uint64 sz, uint64 n)
 {
-	struct timeval td;
 	double	mb, micro;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	micro = td.tv_sec * 1000000 + td.tv_usec;
+	micro = elapsed() * 1000000;
 	micro /= n;
 	mb = sz;
 	mb /= MB;
@@ -304,11 +364,9 @@ micromb(uint64 sz, uint64 n)
 void
 milli(char *s, uint64 n)
 {
-	struct timeval td;
 	uint64 milli;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	milli = td.tv_sec * 1000 + td.tv_usec / 1000;
+	milli = elapsed() * 1000;
 	milli /= n;
 	if (!ftiming) ftiming = stderr;
 	fprintf(ftiming, "%s: %d milliseconds\n", s, (int)milli);
@@ -317,11 +375,9 @@ milli(char *s, uint64 n)
 void
 ptime(uint64 n)
 {
-	struct timeval td;
 	double  s;
 
-	tvsub(&td, &stop_tv, &start_tv);
-	s = td.tv_sec + td.tv_usec / 1000000.0;
+	s = elapsed();
 	if (!ftiming) ftiming = stderr;
 	fprintf(ftiming,
 	    "%d in %.2f secs, %.0f microseconds each\n",
@@ -362,16 +418,13 @@ tvsub(struct timeval * tdiff, struct timeval * t1, struct timeval * t0)
 uint64
 gettime(void)
 {
-	return (tvdelta(&start_tv, &stop_tv));
+	return (stop_ns > start_ns ? (stop_ns - start_ns + 500) / 1000 : 0);
 }
 
 double
 timespent(void)
 {
-	struct timeval td;
-
-	tvsub(&td, &stop_tv, &start_tv);
-	return (td.tv_sec + td.tv_usec / 1000000.0);
+	return (elapsed());
 }
 
 static	char	p64buf[10][20];
@@ -433,7 +486,7 @@ void
 use_int(int result) { use_result_dummy += result; }
 
 void
-use_pointer(void *result) { use_result_dummy += (int)result; }
+use_pointer(void *result) { use_result_dummy += (long)result; }
 
 void
 insertinit(result_t *r)
@@ -441,43 +494,64 @@ insertinit(result_t *r)
 	int	i;
 
 	r->N = 0;
+	r->head = 0;
 	for (i = 0; i < TRIES; i++) {
 		r->u[i] = 0;
 		r->n[i] = 1;
 	}
 }
 
-/* biggest to smallest */
+/*
+ * Record one result.  The table is a ring of TRIES slots filled in
+ * arrival order, so recording costs the same no matter how many results
+ * there are; once it is full the oldest result is overwritten.  Results
+ * are only ordered when they are saved.  (The name is historical.)
+ */
 void
 insertsort(uint64 u, uint64 n, result_t *r)
 {
-	int	i, j;
+	int	i;
 
 	if (u == 0) return;
 
-	for (i = 0; i < r->N; ++i) {
-		if (u/(double)n > r->u[i]/(double)r->n[i]) {
-			for (j = r->N; j > i; --j) {
-				r->u[j] = r->u[j-1];
-				r->n[j] = r->n[j-1];
-			}
-			break;
-		}
+	if (r->N < TRIES) {
+		i = (r->head + r->N++) % TRIES;
+	} else {
+		i = r->head;
+		r->head = (r->head + 1) % TRIES;
 	}
 	r->u[i] = u;
 	r->n[i] = n;
-	r->N++;
 }
 
 static result_t results;
 
+/*
+ * Fill order[] with the slots of results, biggest to smallest per-op time.
+ */
+static void
+rank_results(int *order)
+{
+	int	i, j, k;
+
+	for (i = 0; i < results.N; ++i) {
+		k = (results.head + i) % TRIES;
+		for (j = i; j > 0 && results.u[k] / (double)results.n[k] >
+		    results.u[order[j-1]] / (double)results.n[order[j-1]]; --j)
+			order[j] = order[j-1];
+		order[j] = k;
+	}
+}
+
 void
 print_results(void)
 {
-	int	i;
+	int	i, order[TRIES];
 
+	rank_results(order);
 	for (i = 0; i < results.N; ++i) {
-		fprintf(stderr, "%.2f ", (double)results.u[i]/results.n[i]);
+		fprintf(stderr, "%.2f ",
+		    (double)results.u[order[i]]/results.n[order[i]]);
 	}
 }
 
@@ -497,30 +571,34 @@ save_results(result_t *r)
 void
 save_minimum()
 {
+	int	order[TRIES];
+
 	if (results.N == 0) {
 		save_n(1);
 		settime(0);
 	} else {
-		save_n(results.n[results.N - 1]);
-		settime(results.u[results.N - 1]);
+		rank_results(order);
+		save_n(results.n[order[results.N - 1]]);
+		settime(results.u[order[results.N - 1]]);
 	}
 }
 
 void
 save_median()
 {
-	int	i = results.N / 2;
+	int	i = results.N / 2, order[TRIES];
 	uint64	u, n;
 
+	rank_results(order);
 	if (results.N == 0) {
 		n = 1;
 		u = 0;
 	} else if (results.N % 2) {
-		n = results.n[i];
-		u = results.u[i];
+		n = results.n[order[i]];
+		u = results.u[order[i]];
 	} else {
-		n = (results.n[i] + results.n[i-1]) / 2;
-		u = (results.u[i] + results.u[i-1]) / 2;
+		n = (results.n[order[i]] + results.n[order[i-1]]) / 2;
+		u = (results.u[order[i]] + results.u[order[i-1]]) / 2;
 	}
 	save_n(n); settime(u);
 }
@@ -599,7 +677,6 @@ t_overhead(void)
 	uint64		N_save, u_save;
 	static int	initialized = 0;
 	static uint64	overhead = 0;
-	struct timeval	tv;
 	result_t	r_save;
 
 	init_timing();
@@ -616,7 +693,7 @@ t_overhead(void)
 		get_results(&r_save); N_save = get_n(); u_save = gettime(); 
 		insertinit(&r);
 		for (i = 0; i < TRIES; ++i) {
-			BENCH_INNER(gettimeofday(&tv, 0), 0);
+			BENCH_INNER(use_result_dummy += clock_ns(), 0);
 			insertsort(gettime(), get_n(), &r);
 		}
 		save_results(&r);
@@ -761,7 +838,7 @@ test_time(int enough)
 /*
  * We want to find the smallest timing interval that has accurate timing
  */
-static int     possibilities[] = { 5000, 10000, 50000, 100000 };
+static int     possibilities[] = { 1000, 2500, 5000, 10000, 50000, 100000 };
 static int
 compute_enough()
 {
@@ -26,6 +26,7 @@ void	milli(char *s, uint64 n);
 void	morefds(void);
 void	nano(char *s, uint64 n);
 uint64	now(void);
+uint64	now_ns(void);
 void	ptime(uint64 n);
 void	rusage(void);
 void	save_n(uint64);
@@ -0,0 +1,246 @@
+#include <stdio.h>
+
+#include <stdlib.h>
+
+#ifndef NUM_NODES
+#define NUM_NODES                          100
+#endif
+#define NONE                               9999
+
+/* Arity of the heap. Four children of a node share a cache line, so a
+ * sift-down costs one miss per level and the heap is half as deep as a
+ * binary one.
+ */
+#ifndef HEAP_D
+#define HEAP_D                             4
+#endif
+
+struct _NODE
+{
+  int iDist;
+  int iPrev;
+};
+typedef struct _NODE NODE;
+
+struct _HITEM
+{
+  int iDist;
+  int iNode;
+};
+typedef struct _HITEM HITEM;
+
+/* The pool: every node is in the heap at most once, so NUM_NODES slots
+ * are enough and nothing is allocated while the search runs. iPos maps a
+ * node to its slot, or -1 when it is not queued.
+ */
+HITEM rgHeap[NUM_NODES];
+int iPos[NUM_NODES];
+int g_qCount = 0;
+
+/* Breadth-first order for order_paths(). */
+int rgiOrder[NUM_NODES];
+char rgbSeen[NUM_NODES];
+
+int AdjMatrix[NUM_NODES][NUM_NODES];
+
+NODE rgnNodes[NUM_NODES];
+int ch;
+int iNode;
+int i, iCost, iDist;
+
+int qcount (void)
+{
+  return(g_qCount);
+}
+
+void print_path (NODE *rgnNodes, int chNode)
+{
+  if (rgnNodes[chNode].iPrev != NONE)
+    {
+      print_path(rgnNodes, rgnNodes[chNode].iPrev);
+    }
+  printf (" %d", chNode);
+  fflush(stdout);
+}
+
+int hless (HITEM *a, HITEM *b)
+{
+  return a->iDist < b->iDist;
+}
+
+void hplace (int iSlot, HITEM *item)
+{
+  rgHeap[iSlot] = *item;
+  iPos[item->iNode] = iSlot;
+}
+
+void sift_up (int iSlot, HITEM *item)
+{
+  int iParent;
+
+  while (iSlot > 0)
+    {
+      iParent = (iSlot - 1) / HEAP_D;
+      if (!hless(item, &rgHeap[iParent]))
+        break;
+      hplace(iSlot, &rgHeap[iParent]);
+      iSlot = iParent;
+    }
+  hplace(iSlot, item);
+}
+
+void sift_down (int iSlot, HITEM *item)
+{
+  int iChild, iBest, iLast;
+
+  for (;;)
+    {
+      iChild = iSlot * HEAP_D + 1;
+      if (iChild >= g_qCount)
+        break;
+      iLast = iChild + HEAP_D < g_qCount ? iChild + HEAP_D : g_qCount;
+      for (iBest = iChild++; iChild < iLast; iChild++)
+        if (hless(&rgHeap[iChild], &rgHeap[iBest]))
+          iBest = iChild;
+      if (!hless(&rgHeap[iBest], item))
+        break;
+      hplace(iSlot, &rgHeap[iBest]);
+      iSlot = iBest;
+    }
+  hplace(iSlot, item);
+}
+
+/* Queues iNode at iDist, or moves it up if it is already queued. */
+void enqueue0 (int iNode, int iDist)
+{
+  HITEM item;
+
+  item.iDist = iDist;
+  item.iNode = iNode;
+  if (iPos[iNode] < 0)
+    sift_up(g_qCount++, &item);
+  else
+    sift_up(iPos[iNode], &item);
+}
+
+void dequeue0 (int *piNode, int *piDist)
+{
+  if (g_qCount)
+    {
+      *piNode = rgHeap[0].iNode;
+      *piDist = rgHeap[0].iDist;
+      iPos[*piNode] = -1;
+      if (--g_qCount)
+        sift_down(0, &rgHeap[g_qCount]);
+    }
+}
+
+/* The heap settles on the same costs as the list-based queue of
+ * dijkstra_large.c, but where two paths cost the same it may keep a
+ * different one. The list queue keeps the path through whichever
+ * predecessor it reached first, and it reaches nodes breadth-first along
+ * the edges that lie on shortest paths, scanning neighbours in index
+ * order. Replaying that walk over the final costs picks the same
+ * predecessors, so the printed paths match.
+ */
+void order_paths (int chStart)
+{
+  int iHead = 0, iTail = 0;
+
+  for (ch = 0; ch < NUM_NODES; ch++)
+    rgbSeen[ch] = 0;
+  rgiOrder[iTail++] = chStart;
+  rgbSeen[chStart] = 1;
+  while (iHead < iTail)
+    {
+      iNode = rgiOrder[iHead++];
+      iDist = rgnNodes[iNode].iDist;
+      for (i = 0; i < NUM_NODES; i++)
+	{
+	  if (!rgbSeen[i] && (iCost = AdjMatrix[iNode][i]) != NONE &&
+	      iDist + iCost == rgnNodes[i].iDist)
+	    {
+	      rgbSeen[i] = 1;
+	      rgnNodes[i].iPrev = iNode;
+	      rgiOrder[iTail++] = i;
+	    }
+	}
+    }
+}
+
+int dijkstra(int chStart, int chEnd)
+{
+  for (ch = 0; ch < NUM_NODES; ch++)
+    {
+      rgnNodes[ch].iDist = NONE;
+      rgnNodes[ch].iPrev = NONE;
+      iPos[ch] = -1;
+    }
+
+  if (chStart == chEnd)
+    {
+      printf("Shortest path is 0 in cost. Just stay where you are.\n");
+    }
+  else
+    {
+      rgnNodes[chStart].iDist = 0;
+      rgnNodes[chStart].iPrev = NONE;
+
+      enqueue0 (chStart, 0);
+
+     while (qcount() > 0)
+	{
+	  dequeue0 (&iNode, &iDist);
+	  for (i = 0; i < NUM_NODES; i++)
+	    {
+	      if ((iCost = AdjMatrix[iNode][i]) != NONE)
+		{
+		  if ((NONE == rgnNodes[i].iDist) ||
+		      (rgnNodes[i].iDist > (iCost + iDist)))
+		    {
+		      rgnNodes[i].iDist = iDist + iCost;
+		      enqueue0 (i, iDist + iCost);
+		    }
+		}
+	    }
+	}
+      order_paths (chStart);
+
+      printf("Shortest path is %d in cost. ", rgnNodes[chEnd].iDist);
+      printf("Path is: ");
+      print_path(rgnNodes, chEnd);
+      printf("\n");
+    }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int i,j,k;
+  FILE *fp;
+
+  if (argc<2) {
+    fprintf(stderr, "Usage: dijkstra <filename>\n");
+    fprintf(stderr, "Only supports matrix size is #define'd.\n");
+  }
+
+  /* open the adjacency matrix file */
+  fp = fopen (argv[1],"r");
+
+  /* make a fully connected matrix */
+  for (i=0;i<NUM_NODES;i++) {
+    for (j=0;j<NUM_NODES;j++) {
+      /* make it more sparce */
+      fscanf(fp,"%d",&k);
+			AdjMatrix[i][j]= k;
+    }
+  }
+
+  /* finds 10 shortest paths between nodes */
+  for (i=0,j=NUM_NODES/2;i<100;i++,j++) {
+			j=j%NUM_NODES;
+      dijkstra(i,j);
+  }
+  exit(0);
+
+
+}
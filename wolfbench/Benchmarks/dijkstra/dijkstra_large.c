@@ -2,7 +2,9 @@
 
 #include <stdlib.h>
 
+#ifndef NUM_NODES
 #define NUM_NODES                          100
+#endif
 #define NONE                               9999
 
 struct _NODE
@@ -52,5 +52,8 @@ typedef struct table_t {
 
 /* Perform 1 step for a nodelist */
 void compute_nodes(/*node_t *nodelist*/);
+
+/* Perform 1 step for both lists on OLDEN_THREADS threads (parallel.c) */
+void compute_parallel(node_t *e_nodes, node_t *h_nodes);
 #endif
 
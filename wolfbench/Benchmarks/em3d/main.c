@@ -76,6 +76,8 @@ int main(int argc, char *argv[])
 /*   CMMD_node_timer_start(0); */
 #ifndef PLAIN
   do_all_compute(graph,0,__NumNodes);
+#elif defined(THREADED)
+  compute_parallel(graph->e_nodes[0],graph->h_nodes[0]);
 #else
   compute_nodes(graph->e_nodes[0]);
   compute_nodes(graph->h_nodes[0]);
@@ -0,0 +1,80 @@
+/* parallel.c - threaded compute phase for em3d
+ *
+ * Within a phase every node only reads values of the other kind (E nodes
+ * read H values and vice versa), so the nodes of one list can be updated
+ * in any order. Each list is cut into chunks of CHUNK nodes, and the
+ * chunks run as one phase of the work-stealing scheduler in
+ * olden_threads.c. The E phase ends before the H phase starts.
+ *
+ * The chunks stay linked lists: the list is cut by clearing the next
+ * field of each chunk's last node, so every thread runs the unchanged
+ * compute_nodes() kernel over its chunk. The links are restored at the
+ * end, and each node is updated exactly as the serial code would, so the
+ * values are the same bit for bit.
+ *
+ * The number of threads is OLDEN_THREADS from the environment, or the
+ * number of online processors.
+ */
+
+#include "olden_threads.h"
+#include "em3d.h"
+
+#define CHUNK 256
+
+static node_t **chunks;	/* first node of each chunk */
+static node_t **links;	/* what each chunk's last node pointed to */
+static long nchunks;
+
+/* Cuts nodelist into chunks; returns the number of chunks. */
+static long split_list(node_t *nodelist)
+{
+  long n = 0, count = 0, i;
+  node_t *p, *last;
+
+  for (p = nodelist; p; p = p->next)
+    count++;
+  n = (count + CHUNK - 1) / CHUNK;
+  chunks = (node_t **) realloc(chunks, (n + 1) * sizeof(node_t *));
+  links = (node_t **) realloc(links, (n + 1) * sizeof(node_t *));
+
+  p = nodelist;
+  for (i = 0; i < n; i++) {
+    chunks[i] = p;
+    for (count = 1, last = p; count < CHUNK && last->next; count++)
+      last = last->next;
+    links[i] = last->next;
+    last->next = NULL;
+    p = links[i];
+  }
+  return n;
+}
+
+static void join_list(void)
+{
+  long i;
+  node_t *last;
+
+  for (i = 0; i < nchunks; i++) {
+    for (last = chunks[i]; last->next; last = last->next)
+      ;
+    last->next = links[i];
+  }
+}
+
+static void compute_task(long i)
+{
+  compute_nodes(chunks[i]);
+}
+
+static void parallel_phase(node_t *nodelist)
+{
+  nchunks = split_list(nodelist);
+  olden_phase(compute_task, nchunks);
+  join_list();
+}
+
+void compute_parallel(node_t *e_nodes, node_t *h_nodes)
+{
+  parallel_phase(e_nodes);
+  parallel_phase(h_nodes);
+}
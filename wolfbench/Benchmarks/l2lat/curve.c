@@ -0,0 +1,296 @@
+/*
+ * Load-to-use latency curve.
+ *
+ *   l2lat -curve [-min size] [-max size] [-stride bytes] [-seq] [-huge]
+ *
+ * Sweeps the working set from -min (default 4k) to -max (default 1g) in
+ * steps of 2^k and 1.5*2^k. Without -max the 1g buffer is halved until it
+ * can be mapped, e.g. under RunSafely.sh's ulimit -v; the header line
+ * shows the maximum actually used. At each size a single cycle through every
+ * stride-th slot is chased, one dependent load after another, and the
+ * average time per load is printed. The cycle order is random unless
+ * -seq is given, so hardware prefetchers cannot follow it.
+ *
+ * -huge backs the buffer with huge pages (MAP_HUGETLB, falling back to
+ * transparent huge pages), which takes TLB misses out of the large sizes.
+ *
+ * At the end the curve is split into plateaus: one per cache level that
+ * sysfs reports, plus DRAM beyond the last level cache.
+ */
+#define _GNU_SOURCE   /* MAP_ANONYMOUS, MAP_HUGETLB in strict C89 */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+
+#define MAXPOINTS 64
+#define MAXLEVELS 8
+#define MIN_LOADS (1L << 22)
+
+double second();
+
+static unsigned long rng = 0x2545F4914F6CDD1DUL;
+
+static unsigned long
+next_random()
+{
+  /* xorshift64; deterministic so runs are comparable */
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  return rng;
+}
+
+static long
+parse_size(s)
+  char *s;
+{
+  long n = atol(s);
+  switch (s[strlen(s) - 1]) {
+  case 'g': case 'G': n *= 1024;
+  case 'm': case 'M': n *= 1024;
+  case 'k': case 'K': n *= 1024;
+  }
+  return n;
+}
+
+static char *
+alloc_buffer(size, huge, how)
+  long size;
+  int huge;
+  char **how;
+{
+  char *buf;
+
+  *how = "4k pages";
+  if (huge) {
+    buf = mmap(0, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (buf != MAP_FAILED) {
+      *how = "hugetlbfs pages";
+      return buf;
+    }
+  }
+  buf = mmap(0, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (buf == MAP_FAILED)
+    return 0;
+  if (huge && madvise(buf, size, MADV_HUGEPAGE) == 0)
+    *how = "transparent huge pages";
+  return buf;
+}
+
+/*
+ * Links slots 0..n-1 (stride bytes apart) into one cycle and returns its
+ * first slot. Sattolo's shuffle of the identity gives a random single
+ * cycle; each slot holds its successor's index until the final pass turns
+ * indices into addresses.
+ */
+static void **
+build_chase(buf, n, stride, seq)
+  char *buf;
+  long n, stride;
+  int seq;
+{
+  long i, j, t;
+
+#define SLOT(k) (*(long *)(buf + (k) * stride))
+  for (i = 0; i < n; i++)
+    SLOT(i) = seq ? (i + 1) % n : i;
+  if (!seq) {
+    for (i = n - 1; i > 0; i--) {
+      j = next_random() % i;
+      t = SLOT(i); SLOT(i) = SLOT(j); SLOT(j) = t;
+    }
+  }
+  for (i = 0; i < n; i++)
+    *(void **)(buf + i * stride) = buf + SLOT(i) * stride;
+#undef SLOT
+  return (void **)buf;
+}
+
+static double
+chase(p, loads)
+  void **p;
+  long loads;
+{
+  double t;
+  long i;
+
+  t = second();
+  for (i = 0; i < loads; i += 8) {
+    p = (void **)*p; p = (void **)*p; p = (void **)*p; p = (void **)*p;
+    p = (void **)*p; p = (void **)*p; p = (void **)*p; p = (void **)*p;
+  }
+  t = second() - t;
+  if ((long)p == 1)   /* keep the chain live */
+    fprintf(stderr, "%p\n", (void *)p);
+  return t / loads * 1e9;
+}
+
+static int
+cache_sizes(sizes, levels)
+  long *sizes;
+  int *levels;
+{
+  /* data and unified caches of cpu0, smallest first */
+  char path[128], type[32];
+  FILE *f;
+  int idx, n = 0, level;
+  long size;
+
+  for (idx = 0; idx < 16 && n < MAXLEVELS; idx++) {
+    sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/type", idx);
+    if (!(f = fopen(path, "r")))
+      break;
+    if (fscanf(f, "%31s", type) != 1) type[0] = 0;
+    fclose(f);
+    if (!strcmp(type, "Instruction"))
+      continue;
+    sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", idx);
+    if (!(f = fopen(path, "r")))
+      continue;
+    if (fscanf(f, "%ldK", &size) != 1) size = 0;
+    fclose(f);
+    sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/level", idx);
+    if (!(f = fopen(path, "r")))
+      continue;
+    if (fscanf(f, "%d", &level) != 1) level = 0;
+    fclose(f);
+    if (size > 0) {
+      sizes[n] = size * 1024;
+      levels[n] = level;
+      n++;
+    }
+  }
+  return n;
+}
+
+static int
+cmp_double(a, b)
+  const void *a, *b;
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void
+plateau(name, sizes, lat, npoints, lo, hi)
+  char *name;
+  long *sizes;
+  double *lat;
+  int npoints;
+  long lo, hi;
+{
+  /* median latency of the points with lo < size <= hi */
+  double v[MAXPOINTS];
+  int i, n = 0;
+
+  for (i = 0; i < npoints; i++)
+    if (sizes[i] > lo && sizes[i] <= hi)
+      v[n++] = lat[i];
+  if (n == 0) {
+    printf("%-5s  (not measured, needs sizes in %ldK-%ldK)\n", name, lo / 1024, hi / 1024);
+    return;
+  }
+  qsort(v, n, sizeof(double), cmp_double);
+  printf("%-5s %8.2f ns  (%d points, %ldK-%ldK)\n",
+         name, n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2,
+         n, lo / 1024, hi / 1024);
+}
+
+int
+curve(argc, argv)
+  int argc;
+  char **argv;
+{
+  long minsize = 4 * 1024, maxsize = 1024L * 1024 * 1024, stride = 64;
+  long sizes[MAXPOINTS], caches[MAXLEVELS], size, step, lo;
+  double lat[MAXPOINTS];
+  int levels[MAXLEVELS], npoints = 0, ncaches, seq = 0, huge = 0, fixed = 0, i;
+  char *buf, *how, name[8];
+
+  for (i = 2; i < argc; i++) {
+    if (!strcmp(argv[i], "-min") && i + 1 < argc)
+      minsize = parse_size(argv[++i]);
+    else if (!strcmp(argv[i], "-max") && i + 1 < argc) {
+      maxsize = parse_size(argv[++i]);
+      fixed = 1;
+    }
+    else if (!strcmp(argv[i], "-stride") && i + 1 < argc)
+      stride = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-seq"))
+      seq = 1;
+    else if (!strcmp(argv[i], "-huge"))
+      huge = 1;
+    else {
+      fprintf(stderr, "usage: %s -curve [-min size] [-max size] "
+              "[-stride bytes] [-seq] [-huge]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (stride < (long)sizeof(void *) || minsize < 2 * stride || maxsize < minsize) {
+    fprintf(stderr, "%s: bad size or stride\n", argv[0]);
+    return 1;
+  }
+
+  while (!(buf = alloc_buffer(maxsize, huge, &how))) {
+    if (fixed || maxsize / 2 < minsize) {
+      perror("mmap");
+      return 1;
+    }
+    maxsize /= 2;
+  }
+  printf("# %s chase, %ld byte stride, %s, max %ldK\n",
+         seq ? "sequential" : "random", stride, how, maxsize / 1024);
+  printf("# %10s %10s\n", "size(KB)", "ns/load");
+
+  /* 2^k and 1.5 * 2^k */
+  for (step = 1; step * 2 <= minsize; step *= 2)
+    ;
+  for (size = minsize; size <= maxsize && npoints < MAXPOINTS; ) {
+    long n = size / stride;
+    long loads = n * 2 > MIN_LOADS ? n * 2 : MIN_LOADS;
+
+    chase(build_chase(buf, n, stride, seq), n);   /* warm caches and TLB */
+    lat[npoints] = chase((void **)buf, loads);
+    sizes[npoints] = size;
+    printf("%12ld %10.2f\n", size / 1024, lat[npoints]);
+    fflush(stdout);
+    npoints++;
+
+    if (size < step + step / 2)
+      size = step + step / 2;
+    else
+      size = step *= 2;
+  }
+  munmap(buf, maxsize);
+
+  /* Each cache level owns the sizes that fit in it but not in the level
+   * below; only the lower half of that range is used, to stay clear of
+   * the transition. Everything past 4x the last level is DRAM.
+   */
+  printf("# plateaus\n");
+  ncaches = cache_sizes(caches, levels);
+  lo = 0;
+  for (i = 0; i < ncaches; i++) {
+    if (i == ncaches - 1 && levels[i] > 1)
+      strcpy(name, "LLC");
+    else
+      sprintf(name, "L%d", levels[i]);
+    plateau(name, sizes, lat, npoints, lo, lo + (caches[i] - lo) / 2);
+    lo = caches[i];
+  }
+  if (ncaches)
+    plateau("DRAM", sizes, lat, npoints, 4 * lo, maxsize > 4 * lo ? maxsize : 8 * lo);
+  else
+    printf("# no cache sizes in sysfs, read the levels off the curve\n");
+  return 0;
+}
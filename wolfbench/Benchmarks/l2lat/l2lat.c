@@ -1,16 +1,25 @@
 #include <stdio.h>
+#include <string.h>
 
 #define ITERS 1500
 
 int* a[80000*2];
 
-int main()
+int main(argc, argv)
+  int argc;
+  char **argv;
 {
   double second();
+  int curve();
   double time;
   int **b;
   long int c;
   long i,j,k,l,secx;
+
+  /* -curve: full latency sweep, see curve.c */
+  if (argc > 1 && !strcmp(argv[1], "-curve"))
+    return curve(argc, argv);
+
   /* Load L2 cache */
   for (i=0;i<80000*2;i++){
     a[i]=(int *)&a[i+1];
@@ -23,7 +23,7 @@ static char *localmalloc(int size)
 
 #define localfree(sz)
 
-Hash MakeHash(int size, int (*map)(unsigned int)) 
+Hash MakeHash(int size, int (*map)(unsigned long)) 
 {
   Hash retval;
   int i;
@@ -37,7 +37,7 @@ Hash MakeHash(int size, int (*map)(unsigned int))
   return retval;
 }
 
-void *HashLookup(unsigned int key, Hash hash)
+void *HashLookup(unsigned long key, Hash hash)
 {
   int j;
   HashEntry ent;
@@ -50,7 +50,7 @@ void *HashLookup(unsigned int key, Hash hash)
   return NULL;
 }
 
-void HashInsert(void *entry,unsigned int key,Hash hash) 
+void HashInsert(void *entry,unsigned long key,Hash hash) 
 {
   HashEntry ent;
   int j;
@@ -65,7 +65,7 @@ void HashInsert(void *entry,unsigned int key,Hash hash)
   ent->entry = entry;
 }
 
-void HashDelete(unsigned int key,Hash hash)
+void HashDelete(unsigned long key,Hash hash)
 {
   HashEntry *ent;
   HashEntry tmp;
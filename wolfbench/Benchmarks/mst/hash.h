@@ -1,18 +1,18 @@
 #include "stdio.h"
 
 typedef struct hash_entry {
-  unsigned int key;
+  unsigned long key;
   void *entry;
   struct hash_entry *next;
 } *HashEntry;
 
 typedef struct hash {
   HashEntry *array;
-  int (*mapfunc)(unsigned int);
+  int (*mapfunc)(unsigned long);
   int size;
 } *Hash;
 
-Hash MakeHash(int size, int map(unsigned int));
-void *HashLookup(unsigned int key, Hash hash);
-void HashInsert(void *entry,unsigned int key, Hash hash);
-void HashDelete(unsigned int key, Hash hash);
+Hash MakeHash(int size, int map(unsigned long));
+void *HashLookup(unsigned long key, Hash hash);
+void HashInsert(void *entry,unsigned long key, Hash hash);
+void HashDelete(unsigned long key, Hash hash);
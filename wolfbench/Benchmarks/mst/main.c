@@ -21,7 +21,7 @@ static BlueReturn BlueRule(Vertex inserted, Vertex vlist)
   retval.vert = vlist;
   retval.dist = vlist->mindist;
   hash = vlist->edgehash;
-  dist = (int) HashLookup((unsigned int) inserted, hash);
+  dist = (int) (long) HashLookup((unsigned long) inserted, hash);
   /*chatting("Found %d at 0x%x for 0x%x [0x%x]\n",dist,inserted,hash,vlist);*/
   if (dist) 
     {
@@ -49,7 +49,7 @@ static BlueReturn BlueRule(Vertex inserted, Vertex vlist)
         {
           hash = tmp->edgehash;
           dist2 = tmp->mindist;
-          dist = (int) HashLookup((unsigned int) inserted, hash);
+          dist = (int) (long) HashLookup((unsigned long) inserted, hash);
           /*chatting("Found %d at 0x%x for 0x%x *[0x%x]\n",dist,inserted,hash,tmp);*/
           if (dist) 
             {
@@ -130,7 +130,11 @@ int main(int argc, char *argv[])
   chatting("Graph completed\n");
 
   chatting("About to compute mst \n");
+#ifdef THREADED
+  dist = ComputeMstParallel(graph,size);
+#else
   dist = ComputeMst(graph,size);
+#endif
   chatting("MST has cost %d\n",dist);
 
   return 0;
@@ -29,7 +29,7 @@ static int compute_dist(int i,int j, int numvert)
   return (myrandom(less*numvert+gt) % RANGE)+1;
 }
 
-static int hashfunc(unsigned int key)
+static int hashfunc(unsigned long key)
 {
   return ((key>>10) % HashRange);
 }
@@ -60,7 +60,7 @@ static void AddEdges(int count1, Graph retval, int numproc,
               offset = i % perproc;
               dest = ((helper[pn])+offset);
               hash = tmp->edgehash;
-              HashInsert((void *) dist,(unsigned int) dest,hash);
+              HashInsert((void *) (long) dist,(unsigned long) dest,hash);
             }
         } /* for i... */
       count1++;
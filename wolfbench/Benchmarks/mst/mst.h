@@ -18,3 +18,4 @@ typedef struct graph_st {
   } *Graph;
 
 Graph MakeGraph(int numvert);
+int ComputeMstParallel(Graph graph, int numvert);
@@ -0,0 +1,106 @@
+/* parallel.c - fork-join Prim's algorithm for mst
+ *
+ * ComputeMst() grows the tree one vertex at a time: BlueRule() looks up
+ * the distance from the vertex just inserted in every remaining vertex's
+ * edge hash, lowers that vertex's mindist, and picks the vertex with the
+ * smallest mindist to insert next. The lookups are independent and only
+ * read the hash tables, so here the remaining vertices are kept in an
+ * array, in list order, and each round splits it in halves recursively on
+ * the fork-join pool (olden_threads.c) down to GRAIN vertices. A half's
+ * minimum replaces the left one's only if it is smaller, so ties go to the
+ * vertex first in list order, as in BlueRule(), and the same vertices are
+ * inserted in the same order.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "mst.h"
+#include "olden_threads.h"
+
+#define GRAIN 128
+
+typedef struct blue_job {
+  int lo, hi;		/* range of remaining[] to scan */
+  int at;		/* result: index of the nearest vertex */
+  int dist;		/* and its distance */
+  task_t task;
+} BlueJob;
+
+static Vertex *remaining;
+static Vertex inserted;
+
+static void BlueRange(void *arg)
+{
+  BlueJob *job = (BlueJob *) arg;
+  BlueJob left, right;
+  Vertex tmp;
+  int i, dist;
+
+  if (job->hi - job->lo > GRAIN) {
+    left.lo = job->lo;
+    left.hi = right.lo = (job->lo + job->hi) / 2;
+    right.hi = job->hi;
+    pool_fork(&left.task, BlueRange, &left);
+    BlueRange(&right);
+    pool_join(&left.task);
+    /* Only the results: job->task belongs to the pool while our parent
+     * may be joining it. */
+    if (right.dist < left.dist) {
+      job->at = right.at;
+      job->dist = right.dist;
+    } else {
+      job->at = left.at;
+      job->dist = left.dist;
+    }
+    return;
+  }
+
+  job->dist = 999999;
+  for (i = job->lo; i < job->hi; i++) {
+    tmp = remaining[i];
+    dist = (int) (long) HashLookup((unsigned long) inserted, tmp->edgehash);
+    if (!dist)
+      __Olden_panic("Not found\n");
+    if (dist < tmp->mindist)
+      tmp->mindist = dist;
+    if (tmp->mindist < job->dist) {
+      job->at = i;
+      job->dist = tmp->mindist;
+    }
+  }
+}
+
+int ComputeMstParallel(Graph graph, int numvert)
+{
+  BlueJob all;
+  Vertex v;
+  int cost = 0, n = 0;
+
+  chatting("Compute phase 1\n");
+  pool_init();
+  remaining = (Vertex *) malloc(numvert * sizeof(Vertex));
+  if (!remaining) {
+    chatting("Error! malloc returns null\n");
+    exit(1);
+  }
+
+  /* Insert first node */
+  inserted = graph->vlist[0];
+  for (v = inserted->next; v; v = v->next)
+    remaining[n++] = v;
+  graph->vlist[0] = inserted->next;
+
+  chatting("Compute phase 2\n");
+  while (n) {
+    all.lo = 0;
+    all.hi = n;
+    BlueRange(&all);
+    inserted = remaining[all.at];
+    cost = cost + all.dist;
+    n--;
+    memmove(&remaining[all.at], &remaining[all.at + 1],
+            (n - all.at) * sizeof(Vertex));
+  }
+  free(remaining);
+  return cost;
+}
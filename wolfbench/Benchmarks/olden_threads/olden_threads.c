@@ -0,0 +1,223 @@
+/* olden_threads.c - phases and a fork-join pool, see olden_threads.h
+ *
+ * Phases: the threads wait on a barrier for the next phase and on another
+ * for the end of it; each worker's range is a pair of counters, and a
+ * task is claimed with an atomic increment of the front one.
+ *
+ * Pool: queued tasks sit on one list, newest first, under one lock.
+ * Threads take from the front, which is the most recently forked and so
+ * the smallest piece of work; callers fork only pieces big enough to be
+ * worth a trip through the lock.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "olden_threads.h"
+
+int olden_threads(void)
+{
+  char *s = getenv("OLDEN_THREADS");
+  int n = s ? atoi(s) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (n < 1) n = 1;
+  if (n > OLDEN_MAXTHREADS) n = OLDEN_MAXTHREADS;
+  return n;
+}
+
+/* Phases */
+
+typedef struct worker_t {
+  volatile long next;	/* next task of this worker's range */
+  long end;		/* one past the last task of the range */
+  pthread_t tid;
+  char pad[64];		/* keep workers' counters on separate lines */
+} worker_t;
+
+static worker_t workers[OLDEN_MAXTHREADS];
+static int phase_threads;
+static __thread int self;
+static pthread_barrier_t phase_go, phase_done;
+static void (*phase_task)(long);
+
+int olden_self(void)
+{
+  return self;
+}
+
+static long take(worker_t *w)
+{
+  long i;
+
+  if (w->next >= w->end)
+    return -1;
+  i = __sync_fetch_and_add(&w->next, 1);
+  return i < w->end ? i : -1;
+}
+
+static void run_phase(int id)
+{
+  long i;
+  int v;
+
+  while ((i = take(&workers[id])) >= 0)
+    phase_task(i);
+  for (v = 1; v < phase_threads; v++) {
+    worker_t *victim = &workers[(id + v) % phase_threads];
+
+    while ((i = take(victim)) >= 0)
+      phase_task(i);
+  }
+}
+
+static void *phase_main(void *arg)
+{
+  self = (int)(long)arg;
+  for (;;) {
+    pthread_barrier_wait(&phase_go);
+    run_phase(self);
+    pthread_barrier_wait(&phase_done);
+  }
+  return NULL;
+}
+
+static void phase_init(void)
+{
+  long t;
+
+  phase_threads = olden_threads();
+  pthread_barrier_init(&phase_go, NULL, phase_threads);
+  pthread_barrier_init(&phase_done, NULL, phase_threads);
+  for (t = 1; t < phase_threads; t++)
+    if (pthread_create(&workers[t].tid, NULL, phase_main, (void *)t)) {
+      perror("pthread_create");
+      exit(1);
+    }
+}
+
+void olden_phase(void (*task)(long), long ntasks)
+{
+  int t;
+
+  if (!phase_threads)
+    phase_init();
+  phase_task = task;
+  for (t = 0; t < phase_threads; t++) {
+    workers[t].next = ntasks * t / phase_threads;
+    workers[t].end = ntasks * (t + 1) / phase_threads;
+  }
+  pthread_barrier_wait(&phase_go);
+  run_phase(0);
+  pthread_barrier_wait(&phase_done);
+}
+
+/* Pool */
+
+enum { QUEUED, RUNNING, DONE };
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t finished = PTHREAD_COND_INITIALIZER;
+static task_t *front;
+static int pool_size;
+
+static void unlink_task(task_t *t)
+{
+  if (t->prev)
+    t->prev->next = t->next;
+  else
+    front = t->next;
+  if (t->next)
+    t->next->prev = t->prev;
+}
+
+/* Runs t, which the caller has just taken off the queue; called and
+ * returns with the lock held.
+ */
+static void run_task(task_t *t)
+{
+  t->state = RUNNING;
+  pthread_mutex_unlock(&lock);
+  t->fn(t->arg);
+  pthread_mutex_lock(&lock);
+  t->state = DONE;
+  pthread_cond_broadcast(&finished);
+}
+
+static void *pool_main(void *unused)
+{
+  task_t *t;
+
+  pthread_mutex_lock(&lock);
+  for (;;) {
+    while (front == NULL)
+      pthread_cond_wait(&queued, &lock);
+    t = front;
+    unlink_task(t);
+    run_task(t);
+  }
+  return unused;
+}
+
+void pool_init(void)
+{
+  pthread_t tid;
+  int i;
+
+  if (pool_size)
+    return;
+  pool_size = olden_threads();
+  for (i = 1; i < pool_size; i++)
+    if (pthread_create(&tid, NULL, pool_main, NULL)) {
+      perror("pthread_create");
+      exit(1);
+    }
+}
+
+int pool_threads(void)
+{
+  pool_init();
+  return pool_size;
+}
+
+void pool_fork(task_t *t, void (*fn)(void *), void *arg)
+{
+  t->fn = fn;
+  t->arg = arg;
+  if (pool_threads() == 1) {
+    fn(arg);
+    t->state = DONE;
+    return;
+  }
+  pthread_mutex_lock(&lock);
+  t->state = QUEUED;
+  t->prev = NULL;
+  t->next = front;
+  if (front)
+    front->prev = t;
+  front = t;
+  pthread_cond_signal(&queued);
+  pthread_mutex_unlock(&lock);
+}
+
+void pool_join(task_t *t)
+{
+  task_t *other;
+
+  if (pool_size == 1)
+    return;
+  pthread_mutex_lock(&lock);
+  while (t->state != DONE) {
+    if (t->state == QUEUED) {
+      unlink_task(t);
+      run_task(t);
+    } else if ((other = front) != NULL) {
+      unlink_task(other);
+      run_task(other);
+    } else
+      pthread_cond_wait(&finished, &lock);
+  }
+  pthread_mutex_unlock(&lock);
+}
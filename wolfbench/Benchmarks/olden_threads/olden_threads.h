@@ -0,0 +1,46 @@
+/* olden_threads.h - threads for the THREADED builds of the Olden benchmarks
+ *
+ * em3d, bh, bisort and mst share this file, pulled in through vpath. It
+ * offers two ways of spreading work over the threads:
+ *
+ *   phases  olden_phase(task, n) runs task(0) .. task(n - 1) on all the
+ *           threads and returns once every task is done. The tasks are
+ *           split evenly among the threads; a thread takes from the front
+ *           of its own range and, once that is empty, steals from the
+ *           front of the others'. olden_self() is the calling thread's
+ *           index, 0 on the main thread, for per-thread state.
+ *   pool    pool_fork() queues fn(arg) for any of the pool's threads;
+ *           pool_join() waits for it. A task that no thread has picked up
+ *           by the time it is joined is run by the joining thread itself,
+ *           and a thread waiting on a running task runs other queued tasks
+ *           meanwhile, so tasks may fork and join recursively without
+ *           tying up threads. With one thread pool_fork() runs fn at once.
+ *
+ * Either starts OLDEN_THREADS threads from the environment, counting the
+ * calling one, or one per online processor. bh's stdinc.h defines void as
+ * int, so include this header before it.
+ */
+
+#ifndef OLDEN_THREADS_H
+#define OLDEN_THREADS_H
+
+#define OLDEN_MAXTHREADS 256
+
+int olden_threads(void);
+
+void olden_phase(void (*task)(long), long ntasks);
+int olden_self(void);
+
+typedef struct task_t {
+  void (*fn)(void *);
+  void *arg;
+  volatile int state;
+  struct task_t *prev, *next;	/* queue links while queued */
+} task_t;
+
+void pool_init(void);
+int pool_threads(void);
+void pool_fork(task_t *t, void (*fn)(void *), void *arg);
+void pool_join(task_t *t);
+
+#endif
@@ -3,7 +3,9 @@
 #include <math.h>
 
 #define UNLIMIT
-#define MAXARRAY 60000 /* this number, if too large, will cause a seg. fault!! */
+#ifndef MAXARRAY
+#define MAXARRAY 60000
+#endif
 
 struct my3DVertexStruct {
   int x, y, z;
@@ -26,7 +28,7 @@ int compare(const void *elem1, const void *elem2)
 
 int
 main(int argc, char *argv[]) {
-  struct my3DVertexStruct array[MAXARRAY];
+  static struct my3DVertexStruct array[MAXARRAY];
   FILE *fp;
   int i,count=0;
   int x, y, z;
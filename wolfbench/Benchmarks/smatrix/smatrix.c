@@ -12,7 +12,9 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#ifndef MAXSIZE
 #define MAXSIZE 1024
+#endif
 
 int size=64;
 double total=0;
@@ -23,12 +25,129 @@ float RA[MAXSIZE*MAXSIZE];
 float RB[MAXSIZE*MAXSIZE];
 float RC[MAXSIZE*MAXSIZE];
 
+/* matmult() variants, chosen at build time (see Makefile.in). All of
+ * them add the same products to RC in the same order as the native loop,
+ * so they print the same verification total.
+ */
+#if defined(MATMULT_ACCUM) || defined(MATMULT_AVX2)
+
+/* Keeps RC[C[i][j]] and RA[A[i][j]] in registers across the k loop
+ * instead of loading and storing them on every iteration.
+ */
+static void matmult_accum()
+{
+	int i,j,k;
+	float a,acc;
+	int *b;
+
+	for(i=0;i<size;i++){
+		for(j=0;j<size;j++){
+			RC[C[i][0]] = 0;
+			a = RA[A[i][j]];
+			b = B[j];
+			acc = RC[C[i][j]];
+			for(k=0;k<size;k++)
+				acc = acc + a*RB[b[k]];
+			RC[C[i][j]] = acc;
+		}
+	}
+}
+#endif
+
+#ifdef MATMULT_AVX2
+#include <immintrin.h>
+
+/* As matmult_accum(), but gathers and multiplies eight RB elements at a
+ * time. The products are still added one by one, in k order; the float
+ * sum is not reassociated.
+ */
+__attribute__((target("avx2")))
+static void matmult_avx2()
+{
+	int i,j,k,l;
+	float a,acc;
+	float prod[8];
+	int *b;
+	__m256 va;
+
+	for(i=0;i<size;i++){
+		for(j=0;j<size;j++){
+			RC[C[i][0]] = 0;
+			a = RA[A[i][j]];
+			va = _mm256_set1_ps(a);
+			b = B[j];
+			acc = RC[C[i][j]];
+			for(k=0;k+8<=size;k+=8){
+				_mm256_storeu_ps(prod, _mm256_mul_ps(va,
+				    _mm256_i32gather_ps(RB,
+				    _mm256_loadu_si256((__m256i *)&b[k]), 4)));
+				for(l=0;l<8;l++)
+					acc = acc + prod[l];
+			}
+			for(;k<size;k++)
+				acc = acc + a*RB[b[k]];
+			RC[C[i][j]] = acc;
+		}
+	}
+}
+#endif
+
+#ifdef MATMULT_CSR
+
+/* Row j of RB[B[j][k]] in compressed sparse row form. The k loop only
+ * sums over a row, so no column indices are kept.
+ */
+static int rowstart[MAXSIZE+1];
+static float rowval[MAXSIZE*MAXSIZE];
+
+/* Most of RB is zero, and a zero product leaves the sum unchanged, so
+ * each k loop only visits the row's nonzeros.
+ */
+static void matmult_csr()
+{
+	int i,j,k,n;
+	float a,acc,v;
+
+	n = 0;
+	for(j=0;j<size;j++){
+		rowstart[j] = n;
+		for(k=0;k<size;k++)
+			if( (v = RB[B[j][k]]) != 0 )
+				rowval[n++] = v;
+	}
+	rowstart[size] = n;
+
+	for(i=0;i<size;i++){
+		for(j=0;j<size;j++){
+			RC[C[i][0]] = 0;
+			a = RA[A[i][j]];
+			acc = RC[C[i][j]];
+			for(k=rowstart[j];k<rowstart[j+1];k++)
+				acc = acc + a*rowval[k];
+			RC[C[i][j]] = acc;
+		}
+	}
+}
+#endif
+
 void matmult()
 {
+#if !defined(MATMULT_ACCUM) && !defined(MATMULT_AVX2) && !defined(MATMULT_CSR)
 	int i,j,k;
+#endif
 
 	printf("Native Matrix Multiplication\n");
-	
+
+#if defined(MATMULT_ACCUM)
+	matmult_accum();
+#elif defined(MATMULT_AVX2)
+	if( __builtin_cpu_supports("avx2") )
+		matmult_avx2();
+	else
+		matmult_accum();
+#elif defined(MATMULT_CSR)
+	matmult_csr();
+#else
 	for(i=0;i<size;i++){
 		for(j=0;j<size;j++){
 			RC[C[i][0]] = 0;
@@ -36,6 +155,7 @@ void matmult()
 				RC[C[i][j]] = RC[C[i][j]] + RA[A[i][j]]*RB[B[j][k]];
 		}
 	}
+#endif
 
 }
 
@@ -66,9 +186,10 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/* i*j*i overflows int once size > 1290 (INPUT_SCALE >= 2) */
 	for(i=0;i<size;i++){
 		for(j=0;j<size;j++){
-			RA[A[i][j]] = i*j*i+10;
+			RA[A[i][j]] = (double)i*j*i+10;
 			RB[B[i][j]] = i/(j*i-i*j/3+3);
 		}
 	}
@@ -0,0 +1,309 @@
+/*
+ * A concurrent sqlite workload.
+ *
+ *   sql [-rows N] [-batch N] [-readers N] [-queries N] [-db path] [-v]
+ *
+ * One writer thread fills a table of -rows rows through a prepared INSERT,
+ * committing every -batch rows and updating a few rows of each batch,
+ * while -readers reader threads each run -queries prepared queries against
+ * it: point lookups on the primary key and range scans over a secondary
+ * index. Every thread has its own connection. The database is in WAL mode,
+ * so readers never wait for the writer, and lives on tmpfs (/dev/shm) when
+ * there is one, so the run measures sqlite rather than the disk.
+ *
+ * What the readers see depends on how far the writer has got, so only the
+ * final contents are printed; they are the same on every run. -v adds
+ * throughput figures on stderr.
+ */
+#include "sqlite3.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define CATEGORIES 16
+#define MAXREADERS 64
+
+static long rows = 100000;
+static long batch = 1000;
+static int readers = 4;
+static long queries = 20000;
+static int verbose = 0;
+static char dbpath[256];
+
+static double
+now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, 0);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static unsigned long
+mix(unsigned long x)
+{
+  /* splitmix64 finalizer: row contents are a pure function of the row id */
+  x += 0x9E3779B97F4A7C15UL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9UL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBUL;
+  return x ^ (x >> 31);
+}
+
+static void
+die(sqlite3 *db, const char *what)
+{
+  fprintf(stderr, "%s: %s\n", what, db ? sqlite3_errmsg(db) : "out of memory");
+  exit(1);
+}
+
+static sqlite3 *
+open_db(void)
+{
+  sqlite3 *db;
+
+  if (sqlite3_open(dbpath, &db) != SQLITE_OK)
+    die(db, dbpath);
+  sqlite3_busy_timeout(db, 60000);
+  return db;
+}
+
+static void
+exec(sqlite3 *db, const char *sql)
+{
+  char *err = 0;
+
+  if (sqlite3_exec(db, sql, 0, 0, &err) != SQLITE_OK) {
+    fprintf(stderr, "%s: %s\n", sql, err);
+    exit(1);
+  }
+}
+
+static sqlite3_stmt *
+prepare(sqlite3 *db, const char *sql)
+{
+  sqlite3_stmt *stmt;
+
+  if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+    die(db, sql);
+  return stmt;
+}
+
+static void
+step_done(sqlite3 *db, sqlite3_stmt *stmt)
+{
+  if (sqlite3_step(stmt) != SQLITE_DONE)
+    die(db, sqlite3_sql(stmt));
+  sqlite3_reset(stmt);
+}
+
+static void
+remove_db(void)
+{
+  char path[300];
+
+  unlink(dbpath);
+  sprintf(path, "%s-wal", dbpath);
+  unlink(path);
+  sprintf(path, "%s-shm", dbpath);
+  unlink(path);
+}
+
+static double writer_secs;
+
+static void *
+writer(void *unused)
+{
+  sqlite3 *db = open_db();
+  sqlite3_stmt *ins, *upd, *begin, *commit;
+  char name[32];
+  unsigned long r;
+  long id, end, k;
+  double t = now();
+
+  ins = prepare(db, "INSERT INTO items(id, cat, price, name) VALUES(?, ?, ?, ?)");
+  upd = prepare(db, "UPDATE items SET price = price + 1 WHERE id = ?");
+  begin = prepare(db, "BEGIN");
+  commit = prepare(db, "COMMIT");
+
+  for (id = 1; id <= rows; id = end) {
+    end = id + batch <= rows + 1 ? id + batch : rows + 1;
+    step_done(db, begin);
+    for (k = id; k < end; k++) {
+      r = mix(k);
+      sprintf(name, "item-%08lx", r & 0xffffffffUL);
+      sqlite3_bind_int64(ins, 1, k);
+      sqlite3_bind_int(ins, 2, (int)(r % CATEGORIES));
+      sqlite3_bind_int(ins, 3, (int)((r >> 8) % 100000));
+      sqlite3_bind_text(ins, 4, name, -1, SQLITE_TRANSIENT);
+      step_done(db, ins);
+    }
+    /* touch every 16th row of the batch again, through the primary key */
+    for (k = id; k < end; k += 16) {
+      sqlite3_bind_int64(upd, 1, k);
+      step_done(db, upd);
+    }
+    step_done(db, commit);
+  }
+
+  sqlite3_finalize(ins);
+  sqlite3_finalize(upd);
+  sqlite3_finalize(begin);
+  sqlite3_finalize(commit);
+  sqlite3_close(db);
+  writer_secs = now() - t;
+  return unused;
+}
+
+struct reader_arg {
+  int index;
+  long found;
+  double secs;
+};
+
+static void *
+reader(void *p)
+{
+  struct reader_arg *arg = p;
+  sqlite3 *db = open_db();
+  sqlite3_stmt *point, *range;
+  unsigned long r = mix(1000 + arg->index);
+  long q, lo;
+  double t = now();
+
+  point = prepare(db, "SELECT name, price FROM items WHERE id = ?");
+  range = prepare(db, "SELECT count(*), sum(price) FROM items "
+                      "WHERE cat = ? AND price BETWEEN ? AND ?");
+
+  for (q = 0; q < queries; q++) {
+    r = mix(r);
+    if (q % 4 != 3) {
+      sqlite3_bind_int64(point, 1, (long)(r % rows) + 1);
+      while (sqlite3_step(point) == SQLITE_ROW)
+        arg->found += sqlite3_column_int(point, 1) & 1;
+      sqlite3_reset(point);
+    } else {
+      lo = (r >> 8) % 100000;
+      sqlite3_bind_int(range, 1, (int)(r % CATEGORIES));
+      sqlite3_bind_int(range, 2, (int)lo);
+      sqlite3_bind_int(range, 3, (int)lo + 1000);
+      while (sqlite3_step(range) == SQLITE_ROW)
+        arg->found += sqlite3_column_int(range, 0);
+      sqlite3_reset(range);
+    }
+  }
+
+  sqlite3_finalize(point);
+  sqlite3_finalize(range);
+  sqlite3_close(db);
+  arg->secs = now() - t;
+  return 0;
+}
+
+static void
+report(sqlite3 *db)
+{
+  sqlite3_stmt *stmt;
+  int cat;
+
+  stmt = prepare(db, "SELECT count(*), sum(price), sum(length(name)) FROM items");
+  if (sqlite3_step(stmt) != SQLITE_ROW)
+    die(db, "summary");
+  printf("rows %lld, price total %lld, name bytes %lld\n",
+         sqlite3_column_int64(stmt, 0), sqlite3_column_int64(stmt, 1),
+         sqlite3_column_int64(stmt, 2));
+  sqlite3_finalize(stmt);
+
+  stmt = prepare(db, "SELECT count(*), min(price), max(price), sum(price) "
+                     "FROM items WHERE cat = ?");
+  for (cat = 0; cat < CATEGORIES; cat++) {
+    sqlite3_bind_int(stmt, 1, cat);
+    if (sqlite3_step(stmt) != SQLITE_ROW)
+      die(db, "category");
+    printf("cat %2d: %lld rows, price %lld..%lld, total %lld\n", cat,
+           sqlite3_column_int64(stmt, 0), sqlite3_column_int64(stmt, 1),
+           sqlite3_column_int64(stmt, 2), sqlite3_column_int64(stmt, 3));
+    sqlite3_reset(stmt);
+  }
+  sqlite3_finalize(stmt);
+}
+
+int
+main(int argc, char **argv)
+{
+  pthread_t wtid, rtid[MAXREADERS];
+  struct reader_arg args[MAXREADERS];
+  struct stat st;
+  sqlite3 *db;
+  double qsecs = 0;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-rows") && i + 1 < argc)
+      rows = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-batch") && i + 1 < argc)
+      batch = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-readers") && i + 1 < argc)
+      readers = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-queries") && i + 1 < argc)
+      queries = atol(argv[++i]);
+    else if (!strcmp(argv[i], "-db") && i + 1 < argc)
+      strncpy(dbpath, argv[++i], sizeof(dbpath) - 1);
+    else if (!strcmp(argv[i], "-v"))
+      verbose = 1;
+    else {
+      fprintf(stderr, "usage: %s [-rows N] [-batch N] [-readers N] "
+              "[-queries N] [-db path] [-v]\n", argv[0]);
+      return 1;
+    }
+  }
+  if (rows < 1 || batch < 1 || readers < 0 || readers > MAXREADERS) {
+    fprintf(stderr, "%s: bad -rows, -batch or -readers\n", argv[0]);
+    return 1;
+  }
+  if (!dbpath[0]) {
+    if (stat("/dev/shm", &st) == 0 && S_ISDIR(st.st_mode))
+      sprintf(dbpath, "/dev/shm/wolfbench-sql-%d.db", (int)getpid());
+    else
+      sprintf(dbpath, "workload-%d.db", (int)getpid());
+  }
+
+  /* schema first, so the readers never see a missing table */
+  remove_db();
+  db = open_db();
+  exec(db, "PRAGMA journal_mode=WAL");
+  exec(db, "PRAGMA synchronous=NORMAL");
+  exec(db, "CREATE TABLE items(id INTEGER PRIMARY KEY, cat INTEGER, "
+           "price INTEGER, name TEXT)");
+  exec(db, "CREATE INDEX items_cat_price ON items(cat, price)");
+
+  if (pthread_create(&wtid, 0, writer, 0))
+    die(0, "pthread_create");
+  for (i = 0; i < readers; i++) {
+    args[i].index = i;
+    args[i].found = 0;
+    if (pthread_create(&rtid[i], 0, reader, &args[i]))
+      die(0, "pthread_create");
+  }
+  pthread_join(wtid, 0);
+  for (i = 0; i < readers; i++) {
+    pthread_join(rtid[i], 0);
+    qsecs += args[i].secs;
+  }
+
+  report(db);
+  sqlite3_close(db);
+  remove_db();
+
+  if (verbose) {
+    fprintf(stderr, "writer: %ld rows in %.3f s, %.0f rows/s\n",
+            rows, writer_secs, rows / writer_secs);
+    if (readers)
+      fprintf(stderr, "readers: %d x %ld queries, %.0f queries/s each\n",
+              readers, queries, queries / (qsecs / readers));
+  }
+  return 0;
+}
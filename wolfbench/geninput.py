@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""Deterministic, scaled-up inputs for the wolfbench benchmarks.
+
+    geninput.py <benchmark> <scale> <output>
+    geninput.py -size <benchmark> <scale>
+
+The first form writes an input about <scale> times the size of the
+benchmark's stock input. The second prints the size parameter the program
+has to be built or run with for that input (MAXARRAY, NUM_NODES, MAXSIZE),
+so the Makefiles and this script always agree on it.
+
+The same benchmark and scale always give byte-identical output, on any
+host and Python 3 version: randomness comes from random.random() with a
+fixed seed, whose sequence Python guarantees not to change.
+
+    qsort     50000 * scale random vectors, same format as input_large.dat
+    dijkstra  100 * sqrt(scale) node adjacency matrix, weights 0..100
+    susan     input_large.pgm mirrored out to sqrt(scale) times each side
+    sha       stretches of input_large.asc at random offsets, scale times
+              its length
+    smatrix   no file; the matrix side grows by sqrt(scale)
+"""
+
+import math
+import os
+import random
+import sys
+
+SRC = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'Benchmarks')
+SEED = 6404
+CHUNK = 1 << 20
+
+
+def side(stock, scale):
+    return int(round(stock * math.sqrt(scale)))
+
+
+def size_of(bench, scale):
+    if bench == 'qsort':
+        return 50000 * scale
+    if bench == 'dijkstra':
+        return side(100, scale)
+    if bench == 'smatrix':
+        return side(1024, scale)
+    return None
+
+
+def gen_qsort(scale, out, rng):
+    r = rng.random
+    lines = []
+    for _ in range(size_of('qsort', scale)):
+        lines.append('%d\t%d\t%d\n' % (int(r() * 2147483648),
+                                       int(r() * 2147483648),
+                                       int(r() * 2147483648)))
+        if len(lines) == 65536:
+            out.write(''.join(lines).encode())
+            lines = []
+    out.write(''.join(lines).encode())
+
+
+def gen_dijkstra(scale, out, rng):
+    r = rng.random
+    n = size_of('dijkstra', scale)
+    for _ in range(n):
+        out.write((' '.join(str(int(r() * 101)) for _ in range(n)) + ' \n').encode())
+
+
+def read_pgm(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    fields, pos = [], 0
+    while len(fields) < 4:
+        while data[pos:pos + 1].isspace():
+            pos += 1
+        if data[pos:pos + 1] == b'#':
+            pos = data.index(b'\n', pos)
+            continue
+        end = pos
+        while not data[end:end + 1].isspace():
+            end += 1
+        fields.append(data[pos:end])
+        pos = end
+    w, h = int(fields[1]), int(fields[2])
+    pos += 1
+    return w, h, [data[pos + y * w:pos + (y + 1) * w] for y in range(h)]
+
+
+def gen_susan(scale, out, rng):
+    # Mirroring keeps the edges and corners susan looks for continuous
+    # across tile borders.
+    w, h, rows = read_pgm(os.path.join(SRC, 'susan', 'input_large.pgm'))
+    nw, nh = side(w, scale), side(h, scale)
+    out.write(b'P5\n%d %d\n255\n' % (nw, nh))
+    wide = []
+    for row in rows:
+        period = row + row[::-1]
+        wide.append((period * (nw // len(period) + 1))[:nw])
+    for y in range(nh):
+        k = y % (2 * h)
+        out.write(wide[k if k < h else 2 * h - 1 - k])
+
+
+def gen_sha(scale, out, rng):
+    with open(os.path.join(SRC, 'sha', 'input_large.asc'), 'rb') as f:
+        text = f.read()
+    left = len(text) * scale
+    while left:
+        n = min(CHUNK, left)
+        at = int(rng.random() * (len(text) - CHUNK))
+        out.write(text[at:at + n])
+        left -= n
+
+
+GENERATORS = {
+    'qsort': gen_qsort,
+    'dijkstra': gen_dijkstra,
+    'susan': gen_susan,
+    'sha': gen_sha,
+}
+
+
+def usage():
+    sys.stderr.write(__doc__.split('\n\n')[1] + '\n')
+    sys.exit(1)
+
+
+def main(argv):
+    if len(argv) == 4 and argv[1] == '-size':
+        bench, scale = argv[2], int(argv[3])
+        n = size_of(bench, scale)
+        if n is None:
+            sys.exit('geninput: %s has no size parameter' % bench)
+        print(n)
+        return
+    if len(argv) != 4:
+        usage()
+    bench, scale, path = argv[1], int(argv[2]), argv[3]
+    if bench not in GENERATORS:
+        sys.exit('geninput: no generator for %s (have %s)'
+                 % (bench, ', '.join(sorted(GENERATORS))))
+    if scale < 1:
+        sys.exit('geninput: scale must be at least 1')
+    with open(path + '.tmp', 'wb') as out:
+        GENERATORS[bench](scale, out, random.Random(SEED))
+    os.rename(path + '.tmp', path)
+
+
+if __name__ == '__main__':
+    main(sys.argv)